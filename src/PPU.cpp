@@ -1,6 +1,20 @@
 #include "PPU.h"
+#include "tileDecoder.h"
+#include "renderWorker.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 
+PPU::PPU(Memory& memo, Display& dis) : memory(memo), display(dis), mode(H_BLANK), internalCycles(0),
+        frameComplete(false), lcdOn(memory.LCDC() & 0x80) {
+    memory.onVideoWrite = [this](uint16_t address, uint8_t value) { videoWrite(address, value); };
+}
+
+PPU::~PPU() = default;
+
 inline void PPU::changeMode(int m) {
     memory.STAT() &= 0xFC;
     memory.STAT() |= m;
@@ -9,19 +23,43 @@ inline void PPU::changeMode(int m) {
 
 void PPU::step(int cycles) {
     internalCycles += cycles;
+
+    // Switched off, the LCD has no modes, no interrupts and LY stays at 0. Frames still end on time for the host.
+    if (!lcdOn) {
+        if (internalCycles >= 70224) {
+            internalCycles -= 70224;
+            frameComplete = true;
+            if (rendering)
+                display.renderScreen();
+            startFrame();
+        }
+        return;
+    }
+
     uint8_t& LY = memory.LY();
 
     switch (mode) {
         case H_BLANK:
             if (internalCycles >= 210) {
                 internalCycles -= 210;
-                printScreen(LY);
+                if (rendering) {
+                    pendingLines = LY + 1;
+                    // A worker gets each line as soon as it is due, so it draws while the CPU runs
+                    if (worker)
+                        catchUp();
+                }
 
                 LY++;
 
                 if (LY == 144) {
+                    catchUp();
+                    if (worker)
+                        worker->wait();
                     changeMode(V_BLANK);
                     memory.IF() |= (0x01 << 0);
+                    frameComplete = true;
+                    if (onVBlank)
+                        onVBlank();
                 } else {
                     changeMode(OAM_SEARCH);
                 }
@@ -33,9 +71,11 @@ void PPU::step(int cycles) {
                 LY++;
 
                 if (LY == 154) {
-                    display.renderScreen();
+                    if (rendering)
+                        display.renderScreen();
                     LY = 0;
                     changeMode(OAM_SEARCH);
+                    startFrame();
                 }
             }
             break;
@@ -64,91 +104,281 @@ void PPU::step(int cycles) {
     }
 }
 
+void PPU::startFrame() {
+    renderedLines = 0;
+    pendingLines = 0;
+    if (silent) {
+        rendering = false;
+    } else if (renderRequested || skippedFrames >= frameSkip) {
+        rendering = true;
+        renderRequested = false;
+        skippedFrames = 0;
+    } else {
+        rendering = false;
+        skippedFrames++;
+    }
+}
+
+void PPU::catchUp() {
+    for (; renderedLines < pendingLines; ++renderedLines) {
+        if (worker)
+            worker->pushLine(renderedLines, &memory.IORegisters[0x40]);
+        else
+            printScreen(renderedLines);
+    }
+}
+
+void PPU::catchUpIdle() {
+    int cycles = idleCycles;
+    idleCycles = 0;
+    if (cycles)
+        step(cycles);
+}
+
+void PPU::switchLcd(bool on) {
+    catchUpIdle();
+    lcdOn = on;
+    memory.LY() = 0;
+    internalCycles = 0;
+    renderedLines = 0;
+    pendingLines = 0;
+    if (on) {
+        changeMode(OAM_SEARCH);
+    } else {
+        changeMode(H_BLANK);
+        // A disabled LCD shows a blank screen
+        if (worker)
+            worker->wait();
+        std::memset(display.screenBuffer, 0, 160 * 144);
+    }
+}
+
+void PPU::videoWrite(uint16_t address, uint8_t value) {
+    catchUp();
+    if (address == 0xFF40 && ((value ^ memory.LCDC()) & 0x80))
+        switchLcd(value & 0x80);
+    if (worker) {
+        if (address < 0xFF00)
+            worker->pushWrite(address, value);
+    } else if (address < 0xA000) {
+        background.tileWritten(address - 0x8000);
+    }
+}
+
+void PPU::saveState(PPUState& state) {
+    catchUpIdle();
+    catchUp();
+    if (worker)
+        worker->wait();
+
+    state.mode = mode;
+    state.internalCycles = internalCycles;
+    state.skippedFrames = skippedFrames;
+    state.frameComplete = frameComplete;
+    state.lcdOn = lcdOn;
+    state.rendering = rendering;
+    state.renderRequested = renderRequested;
+}
+
+void PPU::loadState(const PPUState& state) {
+    mode = state.mode;
+    internalCycles = state.internalCycles;
+    idleCycles = 0;
+    skippedFrames = state.skippedFrames;
+    frameComplete = state.frameComplete;
+    lcdOn = state.lcdOn;
+    rendering = state.rendering;
+    renderRequested = state.renderRequested;
+
+    // Lines before LY were drawn when the state was saved
+    renderedLines = (lcdOn && mode != V_BLANK) ? memory.LY() : 0;
+    pendingLines = renderedLines;
+
+    background.invalidate();
+    if (worker)
+        worker->resync(memory);
+}
+
+void PPU::setRenderThread(bool enabled) {
+    catchUp();
+    if (enabled && !worker) {
+        worker.reset(new RenderWorker(memory, display));
+    } else if (!enabled && worker) {
+        worker.reset();
+        // Tile versions were not kept while the worker was drawing
+        background.invalidate();
+    }
+}
+
+// Renderers indexed by LCDC bits 4 (tile data) and 3 (BG map) / 6 (window map)
+void (PPU::* const PPU::backgroundRenderers[4])(int) = {
+        &PPU::printBackground<false, false>, &PPU::printBackground<false, true>,
+        &PPU::printBackground<true, false>, &PPU::printBackground<true, true>
+};
+void (PPU::* const PPU::windowRenderers[4])(int) = {
+        &PPU::printWindow<false, false>, &PPU::printWindow<false, true>,
+        &PPU::printWindow<true, false>, &PPU::printWindow<true, true>
+};
+
 void PPU::printScreen(int LY) {
-    if (memory.LCDC() & 0x01) {
-        printBackground(memory.LY());
-        if (memory.LCDC() & 0x20)
-            printWindow(memory.LY());
+    uint8_t lcdc = memory.LCDC();
+    if (lcdc & 0x01) {
+        (this->*backgroundRenderers[(lcdc >> 3) & 0x03])(LY);
+        if (lcdc & 0x20)
+            (this->*windowRenderers[((lcdc >> 3) & 0x02) | ((lcdc >> 6) & 0x01)])(LY);
     }
-    if (memory.LCDC() & 0x02)
-        printSprites(memory.LY());
+    if (lcdc & 0x02)
+        printSprites(LY);
+}
+
+// Address of a tile row in VRAM, for the 0x8000 (unsigned) and 0x8800 (signed) addressing modes
+template <bool unsignedTiles>
+static inline const uint8_t* tileRow(const uint8_t* vram, uint8_t tileNumber, int row) {
+    int offset = unsignedTiles ? 16 * tileNumber : 0x1000 + 16 * int8_t(tileNumber);
+    return vram + offset + 2 * row;
 }
 
+template <bool unsignedTiles, bool highMap>
 void PPU::printBackground(int LY) {
-    uint16_t tileDataOffset = (memory.LCDC() & 0x10) ? 0x8000 : 0x9000;
-    uint16_t tileMapOffset = (memory.LCDC() & 0x08) ? 0x9C00 : 0x9800;
-    int startingTile = memory.SCX() / 8;
-    int offsetX = memory.SCX() % 8;
-
-    for (int tile = startingTile; tile < startingTile + 21; ++tile) {
-        uint8_t tileNumber = memory.read8(tileMapOffset+32*((((LY + memory.SCY())/8))%32)+tile%32);
-        uint16_t tn = tileNumber;
-        if (!(memory.LCDC() & 0x10))
-            tn = int8_t(tileNumber);
-
-        uint8_t lsbTile = memory.read8(tileDataOffset+16*tn+2*((LY+memory.SCY())%8));
-        uint8_t msbTile = memory.read8(tileDataOffset+16*tn+2*((LY+memory.SCY())%8)+1);
-        for (int pixel = 0; pixel < 8; ++pixel) {
-            uint8_t id = ( (msbTile & (1 << (7-pixel))) >> (7-pixel) )*2 + ( (lsbTile & (1 << (7-pixel))) >> (7-pixel) );
-            int relativePosition = 8*(tile-startingTile) + pixel - offsetX;
-            if (relativePosition >= 0 && relativePosition < 160) {
-                display.screenBuffer[160 * LY + relativePosition] = colors[(memory.BGP() & (0x03 << (2 * id))) >> (2 * id)];
-                BGW1_3[relativePosition] = id;
-            }
-        }
-    }
+    int y = (LY + memory.SCY()) & 0xFF;
+    int scrollX = memory.SCX();
+    const uint8_t* line = background.line(memory.VRAM, highMap, unsignedTiles, y, scrollX / 8);
+
+    // The 160 pixels starting at SCX, wrapping around the 256 pixel map
+    uint8_t ids[160];
+    int first = std::min(160, 256 - scrollX);
+    std::memcpy(ids, line + scrollX, first);
+    std::memcpy(ids + first, line, 160 - first);
+
+    for (int x = 0; x < 160; ++x)
+        BGW1_3[x] = ids[x] ? 0xFF : 0x00;
+    mapPalette(ids, &display.screenBuffer[160 * LY], 160, memory.BGP());
 }
 
+template <bool unsignedTiles, bool highMap>
 void PPU::printWindow(int LY) {
     if (memory.WY() > LY)
         return;
 
-    uint16_t tileDataOffset = (memory.LCDC() & 0x10) ? 0x8000 : 0x9000;
-    uint16_t tileMapOffset = (memory.LCDC() & 0x40) ? 0x9C00 : 0x9800;
     int offsetX = memory.WX()-7;
+    if (offsetX >= 160)
+        return;
+
+    const uint8_t* map = memory.VRAM + (highMap ? 0x1C00 : 0x1800) + 32 * (((LY + memory.WY()) / 8) % 32);
+    int row = (LY + memory.WY()) % 8;
 
+    uint8_t ids[20*8];
     for (int tile = 0; tile < 20; ++tile) {
-        uint8_t tileNumber = memory.read8(tileMapOffset+32*((((LY + memory.WY())/8))%32)+tile%32);
-        uint16_t tn = tileNumber;
-        if (!(memory.LCDC() & 0x10))
-            tn = int8_t(tileNumber);
-
-        uint8_t lsbTile = memory.read8(tileDataOffset+16*tn+2*((LY+memory.WY())%8));
-        uint8_t msbTile = memory.read8(tileDataOffset+16*tn+2*((LY+memory.WY())%8)+1);
-        for (int pixel = 0; pixel < 8; ++pixel) {
-            uint8_t id = ( (msbTile & (1 << (7-pixel))) >> (7-pixel) )*2 + ( (lsbTile & (1 << (7-pixel))) >> (7-pixel) );
-            int relativePosition = 8*tile + pixel + offsetX;
-            if (relativePosition >= 0 && relativePosition < 160) {
-                display.screenBuffer[160 * LY + relativePosition] = colors[(memory.BGP() & (0x03 << (2 * id))) >> (2 * id)];
-            }
-        }
+        const uint8_t* data = tileRow<unsignedTiles>(memory.VRAM, map[tile], row);
+        decodeTileRow(data[0], data[1], &ids[8*tile]);
     }
+
+    // The window covers [offsetX, offsetX + 160) clipped to the screen
+    int start = std::max(0, offsetX);
+    int end = std::min(160, offsetX + 160);
+    for (int x = start; x < end; ++x)
+        BGW1_3[x] = ids[x - offsetX] ? 0xFF : 0x00;
+    mapPalette(&ids[start - offsetX], &display.screenBuffer[160 * LY + start], end - start, memory.BGP());
 }
 
-void PPU::printSprites(int LY) {
-    for (int i = 0; i < 160; i += 4) {
-        uint8_t y = memory.OAM[i] - 9;
+// OAM scan for one line : the first 10 sprites (in OAM order) that cover it, with their row
+// decoded, sorted by drawing priority (lower X first, then lower OAM index)
+int PPU::evaluateSprites(int LY, SpriteLine* sprites) {
+    bool doubleSprite = memory.LCDC() & 0x04;
+    int height = doubleSprite ? 16 : 8;
 
-        bool doubleSprite = memory.LCDC() & 0x04;
-        if (doubleSprite && (y < LY - 8 || y >= LY + 8) || !doubleSprite && (y < LY || y >= LY + 8))
+    int count = 0;
+    for (int i = 0; i < 160 && count < MAX_SPRITES_PER_LINE; i += 4) {
+        int row = LY - (int(memory.OAM[i]) - 16);
+        if (row < 0 || row >= height)
             continue;
 
-        int x = int(memory.OAM[i+1]) - 8;
         uint8_t attributes = memory.OAM[i+3];
-        bool priority = attributes & 0x80;
         bool yFlip = attributes & 0x40;
         bool xFlip = attributes & 0x20;
-        uint8_t palette = (attributes &  0x10) ? memory.OBP1() : memory.OBP0();
-        uint8_t tileId = memory.OAM[i+2] + 1 * yFlip * doubleSprite;
-
-        int address = 0x8000+16*tileId+2*(yFlip*(y-LY) + !yFlip*(7-y+LY));
-        uint8_t lsbTile = memory.read8(address);
-        uint8_t msbTile = memory.read8(address+1);
-        for (int pixel = 0; pixel < 8; ++pixel) {
-            uint8_t id = ( (msbTile & (1 << (7-pixel))) >> (7-pixel) )*2 + ( (lsbTile & (1 << (7-pixel))) >> (7-pixel) );
-            int relativePosition = x + !xFlip*pixel + xFlip*(7 - pixel);
-            if (id != 0 && !(BGW1_3[x + pixel] && priority) && relativePosition >= 0)
-                display.screenBuffer[160 * LY + relativePosition] = colors[(palette & (0x03 << (2*id))) >> (2*id)];
+        uint8_t tileId = memory.OAM[i+2];
+        if (doubleSprite)
+            tileId &= 0xFE;
+        if (yFlip)
+            row = height - 1 - row;
+
+        SpriteLine sprite;
+        sprite.x = int(memory.OAM[i+1]) - 8;
+        sprite.priority = attributes & 0x80;
+
+        uint8_t ids[8];
+        const uint8_t* data = &memory.VRAM[16*tileId + 2*row];
+        decodeTileRow(data[0], data[1], ids);
+        if (xFlip)
+            std::reverse(ids, ids + 8);
+        uint64_t idBits;
+        std::memcpy(&idBits, ids, 8);
+        sprite.opaque = ((idBits | (idBits >> 1)) & 0x0101010101010101ull) * 0xFF;
+        mapPaletteScalar(ids, sprite.shades, 8, (attributes & 0x10) ? memory.OBP1() : memory.OBP0());
+
+        // Insertion sort keeps OAM order between sprites at the same X
+        int j = count++;
+        while (j > 0 && sprites[j-1].x > sprite.x) {
+            sprites[j] = sprites[j-1];
+            j--;
         }
+        sprites[j] = sprite;
+    }
+    return count;
+}
+
+// Sprite pixels replace the line where they are opaque, unless they are behind a non 0 background colour
+static void composeSprites(uint8_t* line, const uint8_t* shades, const uint8_t* opaque, const uint8_t* behind,
+                           const uint8_t* background, int count) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + 16 <= count; i += 16) {
+        __m128i visible = _mm_andnot_si128(
+                _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(behind + i)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + i))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(opaque + i)));
+        __m128i result = _mm_or_si128(
+                _mm_andnot_si128(visible, _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + i))),
+                _mm_and_si128(visible, _mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + i))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(line + i), result);
+    }
+#endif
+    for (; i < count; ++i) {
+        uint8_t visible = opaque[i] & ~(behind[i] & background[i]);
+        line[i] = (line[i] & ~visible) | (shades[i] & visible);
+    }
+}
+
+static inline void blend8(uint8_t* destination, uint64_t value, uint64_t mask) {
+    uint64_t current;
+    std::memcpy(&current, destination, 8);
+    current = (current & ~mask) | (value & mask);
+    std::memcpy(destination, &current, 8);
+}
+
+void PPU::printSprites(int LY) {
+    SpriteLine sprites[MAX_SPRITES_PER_LINE];
+    int count = evaluateSprites(LY, sprites);
+    if (count == 0)
+        return;
+
+    // Sprite layer with a margin of 8 pixels on both sides so that spans never need clipping.
+    // Sprites are drawn from the lowest priority up, the first opaque pixel in priority order wins
+    // even when it is hidden behind the background.
+    uint8_t shades[176] = {};
+    uint8_t opaque[176] = {};
+    uint8_t behind[176] = {};
+    for (int s = count - 1; s >= 0; --s) {
+        const SpriteLine& sprite = sprites[s];
+        if (sprite.x >= 160)
+            continue;
+        int x = sprite.x + 8;
+        uint64_t rowShades;
+        std::memcpy(&rowShades, sprite.shades, 8);
+        blend8(&shades[x], rowShades, sprite.opaque);
+        blend8(&behind[x], sprite.priority ? ~uint64_t(0) : 0, sprite.opaque);
+        blend8(&opaque[x], ~uint64_t(0), sprite.opaque);
     }
-}
\ No newline at end of file
+
+    composeSprites(&display.screenBuffer[160 * LY], &shades[8], &opaque[8], &behind[8], BGW1_3, 160);
+}
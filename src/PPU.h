@@ -4,6 +4,11 @@
 #include "cpu.h"
 #include "memory.h"
 #include "display.h"
+#include "backgroundLayer.h"
+#include <functional>
+#include <memory>
+
+class RenderWorker;
 
 enum : uint8_t {
     H_BLANK = 0b00,
@@ -12,24 +17,92 @@ enum : uint8_t {
     PIXEL_TRANSFER = 0b11
 };
 
+constexpr int MAX_SPRITES_PER_LINE = 10;
+
+// A sprite as seen by one line
+struct SpriteLine {
+    int x;
+    uint8_t shades[8]; // already flipped and mapped through OBP0/OBP1
+    uint64_t opaque; // 0xFF in every byte whose colour id is not 0
+    bool priority;
+};
+
+// What a save state needs from the PPU. The background layer and the render worker are rebuilt instead.
+struct PPUState {
+    int32_t mode;
+    int32_t internalCycles;
+    int32_t skippedFrames;
+    uint8_t frameComplete;
+    uint8_t lcdOn;
+    uint8_t rendering;
+    uint8_t renderRequested;
+};
+
 class PPU {
 public:
-    PPU(Memory& memo, Display& dis) : memory(memo), display(dis), internalCycles(0) {}
+    PPU(Memory& memo, Display& dis);
+    ~PPU();
     void step(int cycles);
+    // Switched off, the LCD only has a frame to end every 70224 cycles : instead of step, idle adds the cycles
+    // up and hands them over when that frame is due. catchUpIdle hands them over before the state is read.
+    void idle(int cycles) {
+        idleCycles += cycles;
+        if (idleCycles >= 70224 - internalCycles)
+            catchUpIdle();
+    }
+    void catchUpIdle();
     void changeMode(int m);
 
     Memory& memory;
     Display& display;
-    bool BGW1_3[160];
+    uint8_t BGW1_3[160]; // 0xFF where the background or window colour id is 1-3
 
     int mode;
     int internalCycles;
+    bool frameComplete;
+    bool lcdOn; // LCDC bit 7
+    std::function<void()> onVBlank;
+
+    // Only one frame in frameSkip + 1 is drawn. Modes, LY, STAT and interrupts are unaffected.
+    int frameSkip = 0;
+    bool silent = false; // frames started meanwhile are neither drawn nor shown, e.g. for run-ahead
+    void requestRender() { renderRequested = true; }
+    bool renderingFrame() const { return rendering; }
+
+    // Lines are drawn lazily : when something they depend on is about to change, or at VBlank
+    void catchUp();
+
+    // Draw on a worker thread instead of the emulation thread. Not compatible with fork().
+    void setRenderThread(bool enabled);
+
+    // Pending lines are drawn first, so the screen buffer is complete when the state is taken
+    void saveState(PPUState& state);
+    void loadState(const PPUState& state);
 
 private:
+    friend class RenderWorker;
+
+    void startFrame();
+    void switchLcd(bool on);
+    void videoWrite(uint16_t address, uint8_t value);
+
+    BackgroundLayer background;
+    bool rendering = true;
+    bool renderRequested = false;
+    int skippedFrames = 0;
+    int renderedLines = 0;
+    int pendingLines = 0;
+    int idleCycles = 0;
+    std::unique_ptr<RenderWorker> worker;
+
     void printScreen(int LY);
-    void printBackground(int LY);
-    void printWindow(int LY);
+    template <bool unsignedTiles, bool highMap> void printBackground(int LY);
+    template <bool unsignedTiles, bool highMap> void printWindow(int LY);
     void printSprites(int LY);
+    int evaluateSprites(int LY, SpriteLine* sprites);
+
+    static void (PPU::* const backgroundRenderers[4])(int);
+    static void (PPU::* const windowRenderers[4])(int);
 };
 
 
@@ -0,0 +1,42 @@
+#include "backgroundLayer.h"
+#include "tileDecoder.h"
+#include <cstring>
+
+static constexpr uint16_t NO_TILE = 0xFFFF;
+
+BackgroundLayer::BackgroundLayer() : pixels(new uint8_t[2 * 256 * 256]) {
+    std::memset(tileVersions, 0, sizeof(tileVersions));
+    invalidate();
+}
+
+void BackgroundLayer::invalidate() {
+    for (int map = 0; map < 2; ++map)
+        for (int cell = 0; cell < 1024; ++cell)
+            cellTiles[map][cell] = NO_TILE;
+}
+
+const uint8_t* BackgroundLayer::line(const uint8_t* vram, bool highMap, bool unsignedTiles, int y, int firstTile) {
+    int map = highMap ? 1 : 0;
+    const uint8_t* entries = vram + (highMap ? 0x1C00 : 0x1800);
+    int rowStart = 32 * (y / 8);
+
+    for (int column = firstTile; column < firstTile + 21; ++column) {
+        int cell = rowStart + column % 32;
+        uint8_t number = entries[cell];
+        // Tiles 0-383 of the tile data, whatever the addressing mode
+        int tile = (unsignedTiles || number >= 128) ? number : 256 + number;
+        if (cellTiles[map][cell] != tile || cellVersions[map][cell] != tileVersions[tile])
+            renderCell(vram, map, cell, tile);
+    }
+    return &pixels[(map * 256 + y) * 256];
+}
+
+void BackgroundLayer::renderCell(const uint8_t* vram, int map, int cell, int tile) {
+    const uint8_t* data = vram + 16 * tile;
+    uint8_t* destination = &pixels[(map * 256 + 8 * (cell / 32)) * 256 + 8 * (cell % 32)];
+    for (int row = 0; row < 8; ++row)
+        decodeTileRow(data[2*row], data[2*row + 1], destination + 256 * row);
+
+    cellTiles[map][cell] = tile;
+    cellVersions[map][cell] = tileVersions[tile];
+}
@@ -0,0 +1,33 @@
+#ifndef EMULATOR_BACKGROUNDLAYER_H
+#define EMULATOR_BACKGROUNDLAYER_H
+
+#include <cstdint>
+#include <memory>
+
+// Both 32x32 tile maps rendered as 256x256 colour ids. Every cell remembers the tile it was
+// drawn from and that tile's version, so cells are redrawn lazily, only when their map entry
+// or their tile data changed. Palette and scrolling are applied per line by the PPU.
+class BackgroundLayer {
+public:
+    BackgroundLayer();
+
+    void invalidate();
+    void tileWritten(uint16_t vramOffset) {
+        if (vramOffset < 0x1800)
+            tileVersions[vramOffset >> 4]++;
+    }
+
+    // Line y of the map, with the 21 cells starting at column firstTile (wrapping) up to date
+    const uint8_t* line(const uint8_t* vram, bool highMap, bool unsignedTiles, int y, int firstTile);
+
+private:
+    void renderCell(const uint8_t* vram, int map, int cell, int tile);
+
+    std::unique_ptr<uint8_t[]> pixels; // [map][y][x]
+    uint16_t cellTiles[2][1024];
+    uint32_t cellVersions[2][1024];
+    uint32_t tileVersions[384];
+};
+
+
+#endif //EMULATOR_BACKGROUNDLAYER_H
@@ -24,15 +24,15 @@ std::unique_ptr<Cartridge> loadRom(const std::string& filename) {
 
     switch (info.cartridgeType) {
         case 0x00:
-            return std::make_unique<NoMBC>(romData, info);
+            return std::make_unique<NoMBC>(romData, size, info);
         case 0x01:
         case 0x02:
         case 0x03:
-            return std::make_unique<MBC1>(romData, info, info.getRamSize());
+            return std::make_unique<MBC1>(romData, size, info, info.getRamSize());
         case 0x11:
         case 0x12:
         case 0x13:
-            return std::make_unique<MBC3>(romData, info, info.getRamSize());
+            return std::make_unique<MBC3>(romData, size, info, info.getRamSize());
         default:
             std::cerr << "MBC type not implemented" << std::endl;
     };
@@ -206,6 +206,72 @@ uint8_t Cartridge::readCart(uint16_t address) {
     return romData[address];
 }
 
+void Cartridge::attach(PageTable& table) {
+    pages = &table;
+    mapRom();
+}
+
+void Cartridge::mapRom() {
+    mapRomBank(0x0000, 0);
+    mapRomBank(0x4000, 1);
+}
+
+void Cartridge::mapRomBank(uint16_t address, size_t bank) {
+    if (!pages)
+        return;
+    // Bank numbers wrap around the actual ROM size like the address lines do
+    bank %= romBanks;
+    for (int page = 0; page < 0x40; ++page)
+        pages->mapRead((address >> 8) + page, romPage(bank, page));
+}
+
+uint8_t* Cartridge::romPage(size_t bank, int page) {
+    if (!romPatches.empty()) {
+        auto patch = romPatches.find((bank << 8) | page);
+        if (patch != romPatches.end())
+            return patch->second.data();
+    }
+    return reinterpret_cast<uint8_t*>(romData) + 0x4000 * bank + (page << 8);
+}
+
+void Cartridge::patchRom(uint16_t address, uint8_t value, int compare) {
+    if (address >= 0x8000)
+        return;
+
+    size_t firstBank = (address < 0x4000) ? 0 : 1;
+    size_t lastBank = (address < 0x4000) ? 1 : romBanks;
+    for (size_t bank = firstBank; bank < lastBank; ++bank) {
+        size_t offset = 0x4000 * bank + (address & 0x3FFF);
+        if (compare >= 0 && uint8_t(romData[offset]) != compare)
+            continue;
+
+        std::vector<uint8_t>& page = romPatches[(bank << 8) | ((address & 0x3FFF) >> 8)];
+        if (page.empty()) {
+            uint8_t* original = reinterpret_cast<uint8_t*>(romData) + (offset & ~size_t(0xFF));
+            page.assign(original, original + 0x100);
+        }
+        page[address & 0xFF] = value;
+    }
+    mapRom();
+}
+
+void Cartridge::clearPatches() {
+    romPatches.clear();
+    mapRom();
+}
+
+void MBC1::mapRom() {
+    mapRomBank(0x0000, 0);
+    mapRomBank(0x4000, romBankNumber);
+}
+
+void MBC1::restoreBankState(uint32_t state) {
+    romBankNumber = state & 0xFF;
+    ramBankNumber = (state >> 8) & 0xFF;
+    ramEnabled = (state >> 16) & 0x01;
+    mapRom();
+}
+
 uint8_t MBC1::readCart(uint16_t address) {
     if (address < 0x4000) {
         return romData[address];
@@ -227,15 +293,30 @@ void MBC1::writeCart(uint16_t address, uint8_t value) {
     } else if (address < 0x4000) { // 0x2000–0x3FFF
         romBankNumber = value & 0x1F;
         romBankNumber = romBankNumber ? romBankNumber : 0x01;
+        mapRomBank(0x4000, romBankNumber);
     } else if (address < 0x6000) { // 0x4000–0x5FFF
         ramBankNumber = value & 0x03;
     } else if (address >= 0xA000 && address < 0xC000) {
         if (!ramEnabled)
             return;
-        ramData[address - 0xA000 + 0x2000 * ramBankNumber] = value;
+        uint32_t offset = address - 0xA000 + 0x2000 * ramBankNumber;
+        ramData[offset] = value;
+        ramDirty.mark(offset);
     }
 }
 
+void MBC3::mapRom() {
+    mapRomBank(0x0000, 0);
+    mapRomBank(0x4000, romBankNumber);
+}
+
+void MBC3::restoreBankState(uint32_t state) {
+    romBankNumber = state & 0xFF;
+    ramBankNumber = (state >> 8) & 0xFF;
+    ramEnabled = (state >> 16) & 0x01;
+    mapRom();
+}
+
 uint8_t MBC3::readCart(uint16_t address) {
     if (address < 0x4000) {
         return romData[address];
@@ -255,11 +336,14 @@ void MBC3::writeCart(uint16_t address, uint8_t value) {
     else if (address < 0x4000){ // 0x2000–0x3FFF
         romBankNumber = value & 0x7F;
         romBankNumber = romBankNumber ? romBankNumber : 0x01;
+        mapRomBank(0x4000, romBankNumber);
     } else if (address < 0x6000) // 0x4000–0x5FFF
         ramBankNumber = value & 0x03;
     else if(address >= 0xA000 && address < 0xC000) {
         if (!ramEnabled)
             return;
-        ramData[address - 0xA000 + 0x2000 * ramBankNumber] = value;
+        uint32_t offset = address - 0xA000 + 0x2000 * ramBankNumber;
+        ramData[offset] = value;
+        ramDirty.mark(offset);
     }
 }
\ No newline at end of file
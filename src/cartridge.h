@@ -10,6 +10,9 @@
 #include <iterator>
 #include <memory>
 #include <cstring>
+#include <unordered_map>
+#include "dirtyMap.h"
+#include "pageTable.h"
 
 struct CartridgeInfo  {
     std::string title;
@@ -26,33 +29,65 @@ struct CartridgeInfo  {
 class Cartridge {
 public:
 
-    Cartridge(char* rom, CartridgeInfo inf) : romData(rom), info(std::move(inf)) {};
-    virtual ~Cartridge() { delete romData; }
+    Cartridge(char* rom, size_t romSize, CartridgeInfo inf, int ramSize = 0) : romData(rom), romSize(romSize),
+            romBanks(std::max<size_t>(romSize / 0x4000, 1)), info(std::move(inf)),
+            ramData(ramSize ? new char[ramSize] : nullptr), ramSize(ramSize) {
+        if (ramData)
+            std::memset(ramData, 0, ramSize);
+    };
+    virtual ~Cartridge() { delete[] romData; delete[] ramData; }
 
     void printInfo();
     virtual uint8_t readCart(uint16_t address);
     virtual void writeCart(uint16_t address, uint8_t value) {}
+    virtual uint32_t bankState() const { return 0; }
+    virtual void restoreBankState(uint32_t state) {}
+
+    // Maps the ROM banks in the page table and keeps them mapped on bank switches
+    void attach(PageTable& table);
+
+    // ROM patches (Game Genie) : patched copies of the ROM pages are mapped instead of
+    // the originals, in every bank where the compare value matches (-1 matches any)
+    void patchRom(uint16_t address, uint8_t value, int compare);
+    void clearPatches();
+
+    const uint8_t* rom() const { return reinterpret_cast<const uint8_t*>(romData); }
+    size_t romLength() const { return romSize; }
+    uint8_t* ram() { return reinterpret_cast<uint8_t*>(ramData); }
+    int ramLength() const { return ramSize; }
+
+    RamDirtyMap ramDirty;
 protected:
+    virtual void mapRom();
+    void mapRomBank(uint16_t address, size_t bank);
+    uint8_t* romPage(size_t bank, int page);
+
     char* romData;
+    size_t romSize;
+    size_t romBanks;
+    std::unordered_map<uint32_t, std::vector<uint8_t>> romPatches; // (bank << 8) | page
+    PageTable* pages = nullptr;
     CartridgeInfo info;
+    char* ramData;
+    int ramSize;
 };
 
 
 class NoMBC : public Cartridge {
 public:
-    NoMBC(char* rom, CartridgeInfo inf) : Cartridge(rom, std::move(inf)) {}
+    NoMBC(char* rom, size_t romSize, CartridgeInfo inf) : Cartridge(rom, romSize, std::move(inf)) {}
 };
 
 class MBC1 : public Cartridge {
 public:
-    MBC1(char* rom, CartridgeInfo inf, int ramSize) : Cartridge(rom, std::move(inf)), ramData(new char[ramSize]) {
-        std::memset(ramData, 0, ramSize);
-    }
+    MBC1(char* rom, size_t romSize, CartridgeInfo inf, int ramSize) : Cartridge(rom, romSize, std::move(inf), ramSize) {}
 
     uint8_t readCart(uint16_t address) override;
     void writeCart(uint16_t address, uint8_t value) override;
+    uint32_t bankState() const override { return romBankNumber | (ramBankNumber << 8) | (ramEnabled << 16); }
+    void restoreBankState(uint32_t state) override;
 private:
-    char* ramData;
+    void mapRom() override;
 
     bool ramEnabled = false;
     uint8_t romBankNumber = 0x01;
@@ -61,14 +96,14 @@ private:
 
 class MBC3 : public Cartridge {
 public:
-    MBC3(char* rom, CartridgeInfo inf, int ramSize) : Cartridge(rom, std::move(inf)), ramData(new char[ramSize]) {
-        std::memset(ramData, 0, ramSize);
-    }
+    MBC3(char* rom, size_t romSize, CartridgeInfo inf, int ramSize) : Cartridge(rom, romSize, std::move(inf), ramSize) {}
 
     uint8_t readCart(uint16_t address) override;
     void writeCart(uint16_t address, uint8_t value) override;
+    uint32_t bankState() const override { return romBankNumber | (ramBankNumber << 8) | (ramEnabled << 16); }
+    void restoreBankState(uint32_t state) override;
 private:
-    char* ramData;
+    void mapRom() override;
 
     bool ramEnabled = false;
     uint8_t romBankNumber = 0x01;
@@ -0,0 +1,61 @@
+#include "cheats.h"
+#include <cctype>
+
+bool Cheats::add(const std::string& code) {
+    std::string digits;
+    for (char c : code) {
+        if (std::isxdigit(static_cast<unsigned char>(c)))
+            digits += char(std::toupper(static_cast<unsigned char>(c)));
+        else if (c != '-')
+            return false;
+    }
+
+    if (digits.size() == 8)
+        return addGameShark(digits);
+    if (digits.size() == 6 || digits.size() == 9)
+        return addGameGenie(digits);
+
+    std::cerr << "Unknown cheat code format : " << code << std::endl;
+    return false;
+}
+
+void Cheats::clear() {
+    ramCodes.clear();
+    if (memory.cart)
+        memory.cart->clearPatches();
+}
+
+// ABC-DEF-GHI : AB new value, FCDE address with F inverted, GI scrambled compare value
+bool Cheats::addGameGenie(const std::string& digits) {
+    if (!memory.cart)
+        return false;
+
+    int d[9];
+    for (size_t i = 0; i < digits.size(); ++i)
+        d[i] = std::stoi(digits.substr(i, 1), nullptr, 16);
+
+    uint8_t value = (d[0] << 4) | d[1];
+    uint16_t address = ((d[5] ^ 0xF) << 12) | (d[2] << 8) | (d[3] << 4) | d[4];
+    int compare = -1;
+    if (digits.size() == 9) {
+        uint8_t scrambled = (d[6] << 4) | d[8];
+        compare = uint8_t((scrambled >> 2) | (scrambled << 6)) ^ 0xBA;
+    }
+
+    memory.cart->patchRom(address, value, compare);
+    return true;
+}
+
+// TTVVAAAA : type, value, address stored little endian
+bool Cheats::addGameShark(const std::string& digits) {
+    uint32_t code = std::stoul(digits, nullptr, 16);
+    uint8_t value = (code >> 16) & 0xFF;
+    uint16_t address = ((code & 0xFF) << 8) | ((code >> 8) & 0xFF);
+    ramCodes.push_back({address, value});
+    return true;
+}
+
+void Cheats::applyRamCodes() {
+    for (const RamCode& code : ramCodes)
+        memory.write8(code.address, code.value);
+}
@@ -0,0 +1,32 @@
+#ifndef EMULATOR_CHEATS_H
+#define EMULATOR_CHEATS_H
+
+#include "memory.h"
+#include <string>
+#include <vector>
+
+// Game Genie codes patch the ROM through the cartridge page mapping and GameShark
+// codes are written once per frame at VBlank, so neither costs anything per access.
+class Cheats {
+public:
+    Cheats(Memory& mem) : memory(mem) {}
+
+    bool add(const std::string& code);
+    void clear();
+    void applyRamCodes();
+
+private:
+    bool addGameGenie(const std::string& digits);
+    bool addGameShark(const std::string& digits);
+
+    struct RamCode {
+        uint16_t address;
+        uint8_t value;
+    };
+
+    Memory& memory;
+    std::vector<RamCode> ramCodes;
+};
+
+
+#endif //EMULATOR_CHEATS_H
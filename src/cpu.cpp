@@ -24,7 +24,7 @@ int& CPU::step() {
 
     cycles = 0;
 
-    uint8_t opcode = memory.read8(regs.pc++);
+    uint8_t opcode = memory.fetch8(regs.pc++);
     Instruction instruction = instructions_set[opcode];
 
     switch(instruction.byteLength) {
@@ -0,0 +1,112 @@
+#include "debugger.h"
+#include "gameBoy.h"
+#include "timeTravel.h"
+#include <iomanip>
+
+Debugger::Debugger(GameBoy& gb) : gameBoy(gb), insideAccess(false) {}
+
+Debugger::~Debugger() = default;
+
+void Debugger::attach() {
+    gameBoy.memory.onWatch = [this](uint16_t address, uint8_t type) { onWatch(address, type); };
+    history.reset(new TimeTravel(gameBoy));
+    gameBoy.timeTravel = history.get();
+}
+
+void Debugger::onWatch(uint16_t address, uint8_t type) {
+    const char* name = (type == WATCH_EXECUTE) ? "execute" : (type == WATCH_WRITE) ? "write" : "read";
+    std::cout << "### Watchpoint : " << name << " 0x" << std::hex << std::setw(4) << std::setfill('0')
+              << address << std::endl;
+    // Accesses are reported before they happen, so the prompt shows the state just before
+    insideAccess = true;
+    prompt();
+    insideAccess = false;
+}
+
+void Debugger::prompt() {
+    gameBoy.pausing = false;
+    gameBoy.cpu.showState();
+
+    std::string line;
+    while (std::cout << "(debug) " << std::flush, std::getline(std::cin, line)) {
+        if (!execute(line))
+            return;
+    }
+    gameBoy.running = false;
+}
+
+// Returns false when emulation should resume
+bool Debugger::execute(const std::string& line) {
+    std::istringstream input(line);
+    std::string command;
+    input >> command;
+
+    if (command == "c") { // continue
+        return false;
+    } else if (command == "s") { // step one instruction
+        gameBoy.pausing = true;
+        return false;
+    } else if (command == "q") { // quit
+        gameBoy.running = false;
+        return false;
+    } else if (command == "r") { // registers
+        gameBoy.cpu.showState();
+    } else if (command == "m") { // m address [length]
+        unsigned address = 0, length = 16;
+        input >> std::hex >> address >> length;
+        for (unsigned i = 0; i < length; ++i) {
+            if (i % 16 == 0)
+                std::cout << (i ? "\n" : "") << std::hex << std::setw(4) << std::setfill('0') << (address + i) << ":";
+            std::cout << " " << std::setw(2) << int(gameBoy.memory.peek(address + i));
+        }
+        std::cout << std::endl;
+    } else if (command == "w") { // w r|w|x start [end]
+        std::string kind;
+        unsigned start = 0, end = 0;
+        input >> kind >> std::hex >> start;
+        if (!(input >> end))
+            end = start;
+        uint8_t type = (kind == "x") ? WATCH_EXECUTE : (kind == "w") ? WATCH_WRITE : WATCH_READ;
+        gameBoy.memory.addWatch(start, end, type);
+    } else if (command == "d") { // delete all watchpoints
+        gameBoy.memory.clearWatches();
+    } else if (command == "bs" || command == "bl" || command == "bf" || command == "rc") {
+        travel(command);
+    } else if (!command.empty()) {
+        std::cout << "Commands : c, s, q, r, m addr [len], w r|w|x start [end], d, bs, bl, bf, rc" << std::endl;
+    }
+    return true;
+}
+
+// bs, bl and bf step back one instruction, scanline or frame, rc goes back to the last watched write
+void Debugger::travel(const std::string& command) {
+    if (!history)
+        return;
+    if (insideAccess) {
+        std::cout << "Step to the end of the instruction (s) first" << std::endl;
+        return;
+    }
+    // Recorders only go forward, what they already have would be replayed differently
+    if (gameBoy.recorder) {
+        std::cout << "Cannot go back while recording" << std::endl;
+        return;
+    }
+
+    if (command == "rc") {
+        bool watchingWrites = false;
+        for (const Memory::Watchpoint& watch : gameBoy.memory.watchpoints)
+            watchingWrites |= (watch.type & WATCH_WRITE) != 0;
+        if (!watchingWrites) {
+            std::cout << "No write watchpoint" << std::endl;
+            return;
+        }
+        if (!history->reverseContinue())
+            std::cout << "No watched write since cycle " << std::dec << history->oldestCycle() << std::endl;
+    } else {
+        uint64_t cycles = (command == "bf") ? CYCLES_PER_FRAME : (command == "bl") ? CYCLES_PER_LINE : 1;
+        if (!history->stepBack(cycles))
+            std::cout << "History starts at cycle " << std::dec << history->oldestCycle() << std::endl;
+    }
+    std::cout << "### Cycle " << std::dec << gameBoy.totalCycles << std::endl;
+    gameBoy.cpu.showState();
+}
@@ -0,0 +1,31 @@
+#ifndef EMULATOR_DEBUGGER_H
+#define EMULATOR_DEBUGGER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class GameBoy;
+class TimeTravel;
+
+// Console debugger driven from stdin, entered on watchpoint hits
+class Debugger {
+public:
+    Debugger(GameBoy& gb);
+    ~Debugger();
+
+    void attach();
+    void onWatch(uint16_t address, uint8_t type);
+    void prompt();
+
+private:
+    bool execute(const std::string& line);
+    void travel(const std::string& command);
+
+    GameBoy& gameBoy;
+    std::unique_ptr<TimeTravel> history;
+    bool insideAccess; // prompted by a watchpoint, in the middle of an instruction
+};
+
+
+#endif //EMULATOR_DEBUGGER_H
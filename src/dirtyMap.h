@@ -0,0 +1,67 @@
+#ifndef EMULATOR_DIRTYMAP_H
+#define EMULATOR_DIRTYMAP_H
+
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+inline int countTrailingZeros(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return int(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// One bit per 256 B page
+template <int Pages>
+struct DirtyMap {
+    static constexpr int PAGE_SHIFT = 8;
+    static constexpr int PAGE_SIZE = 1 << PAGE_SHIFT;
+    static constexpr int WORDS = (Pages + 63) / 64;
+
+    uint64_t bits[WORDS] = {};
+
+    void mark(uint32_t offset) {
+        uint32_t page = offset >> PAGE_SHIFT;
+        bits[page >> 6] |= uint64_t(1) << (page & 0x3F);
+    }
+    void markPage(int page) { bits[page >> 6] |= uint64_t(1) << (page & 0x3F); }
+    bool test(int page) const { return (bits[page >> 6] >> (page & 0x3F)) & 1; }
+    void clear() { std::memset(bits, 0, sizeof(bits)); }
+
+    bool any() const {
+        for (uint64_t word : bits)
+            if (word)
+                return true;
+        return false;
+    }
+
+    DirtyMap& operator|=(const DirtyMap& other) {
+        for (int i = 0; i < WORDS; ++i)
+            bits[i] |= other.bits[i];
+        return *this;
+    }
+
+    // Calls f(page) for every dirty page, in increasing order
+    template <typename F>
+    void forEach(F f) const {
+        for (int i = 0; i < WORDS; ++i) {
+            uint64_t word = bits[i];
+            while (word) {
+                int bit = countTrailingZeros(word);
+                f(i * 64 + bit);
+                word &= word - 1;
+            }
+        }
+    }
+};
+
+typedef DirtyMap<256> AddressDirtyMap; // 0x0000 - 0xFFFF
+typedef DirtyMap<512> RamDirtyMap; // up to 128 KiB of cartridge RAM
+
+#endif //EMULATOR_DIRTYMAP_H
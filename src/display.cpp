@@ -1,23 +1,71 @@
 #include "display.h"
+#include "tileDecoder.h"
 
-Display::Display(Memory& memo) : window(sf::VideoMode(160, 144), "TinyBoy") {
+Display::Display(Memory& memo, bool headless, uint8_t* external)
+        : ownedBuffer(external ? nullptr : new uint8_t[160*144]()), screenBuffer(external ? external : ownedBuffer.get()),
+          stopping(false) {
+    setPalette(PALETTE_GREEN);
+    if (headless)
+        return;
+    window.create(sf::VideoMode(160, 144), "TinyBoy");
     window.setSize(sf::Vector2u(640, 576));
+
+    // The OpenGL context moves to the presenter
+    window.setActive(false);
+    presenter = std::thread(&Display::present, this);
+}
+
+Display::~Display() {
+    if (!presenter.joinable())
+        return;
+    stopping = true;
+    wake.notify_one();
+    presenter.join();
 }
 
 void Display::renderScreen() {
-    window.clear();
+    if (!presenter.joinable())
+        return;
 
-    image.create(160, 144, reinterpret_cast<uint8_t*>(screenBuffer));
+    std::memcpy(frames.back(), screenBuffer, 160*144);
+    frames.publish();
+    wake.notify_one();
+}
 
-    texture.loadFromImage(image);
-    sprite.setTexture(texture);
+void Display::present() {
+    window.setActive(true);
 
-    window.draw(sprite);
+    sf::Texture texture;
+    texture.create(160, 144);
+    sf::Sprite sprite(texture);
+    std::unique_ptr<Pixel[]> pixels(new Pixel[160*144]);
 
-    window.display();
-}
+    while (!stopping) {
+        const uint8_t* frame = frames.acquire();
+        if (!frame) {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(20));
+            continue;
+        }
 
+        expandShades(frame, pixels.get(), 160*144, palette);
+        texture.update(reinterpret_cast<const sf::Uint8*>(pixels.get()));
 
+        window.clear();
+        window.draw(sprite);
+        window.display();
+    }
+
+    window.setActive(false);
+}
+void Display::setPalette(const Pixel* colors) {
+    std::memcpy(palette, colors, sizeof(palette));
+}
+
+const Pixel* Display::expandFrame() {
+    expandShades(screenBuffer, rgbaBuffer, 160*144, palette);
+    return rgbaBuffer;
+}
 
 void Display::callback(bool& running) {
     sf::Event event;
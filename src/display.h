@@ -4,6 +4,11 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
 #include "memory.h"
+#include "tripleBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 struct Pixel {
     uint8_t r;
@@ -12,28 +17,44 @@ struct Pixel {
     uint8_t a;
 };
 
-/*constexpr Pixel colors[4] = {Pixel{255, 255, 255, 255}, Pixel{174,174,174,255},
-                             Pixel{92,92,92,255}, Pixel{10,10,10,255}};*/
+// Colours of the 4 shades, selectable with Display::setPalette
+constexpr Pixel PALETTE_GREY[4] = {Pixel{255, 255, 255, 255}, Pixel{174,174,174,255},
+                                   Pixel{92,92,92,255}, Pixel{10,10,10,255}};
 
-/*constexpr Pixel colors[4] = {Pixel{255, 200, 255, 255}, Pixel{185,115,185,255},
-                             Pixel{120,51,120,255}, Pixel{28,12,28,255}};*/
+constexpr Pixel PALETTE_PURPLE[4] = {Pixel{255, 200, 255, 255}, Pixel{185,115,185,255},
+                                     Pixel{120,51,120,255}, Pixel{28,12,28,255}};
 
-constexpr Pixel colors[4] = {Pixel{224, 248, 208, 255}, Pixel{136,192,112,255},
-                             Pixel{52,104,86,255}, Pixel{8,24,32,255}};
+constexpr Pixel PALETTE_GREEN[4] = {Pixel{224, 248, 208, 255}, Pixel{136,192,112,255},
+                                    Pixel{52,104,86,255}, Pixel{8,24,32,255}};
 
 class Display {
 public:
-    Display(Memory& memo);
+    Display(Memory& memo, bool headless = false, uint8_t* external = nullptr);
+    ~Display();
 
     void renderScreen();
     void callback(bool& running);
+    void setPalette(const Pixel* colors);
+    const Pixel* expandFrame();
 
 
     sf::RenderWindow window;
-    Pixel screenBuffer[160*144];
-    sf::Image image;
-    sf::Texture texture;
-    sf::Sprite sprite;
+    // Shades (0-3) written by the PPU, already mapped through BGP/OBP
+    std::unique_ptr<uint8_t[]> ownedBuffer;
+    uint8_t* screenBuffer;
+    Pixel palette[4];
+    Pixel rgbaBuffer[160*144];
+
+private:
+    void present();
+
+    // Completed frames go to a presenter thread, so a slow window swap never stalls the emulation.
+    // Events are still polled by callback, on the thread that created the window.
+    TripleBuffer<uint8_t, 160*144> frames;
+    std::thread presenter;
+    std::atomic<bool> stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
 };
 
 
@@ -0,0 +1,59 @@
+#include "encoding.h"
+
+void encodeXor(const uint8_t* a, const uint8_t* b, size_t length, std::vector<uint8_t>& out) {
+    auto at = [a, b](size_t i) { return uint8_t(b ? a[i] ^ b[i] : a[i]); };
+    size_t i = 0;
+    while (i < length) {
+        bool zero = at(i) == 0;
+        size_t run = 1;
+        while (i + run < length && run < 128 && (at(i + run) == 0) == zero)
+            run++;
+        if (zero) {
+            out.push_back(uint8_t(run - 1));
+        } else {
+            out.push_back(uint8_t(0x7F + run));
+            for (size_t j = 0; j < run; ++j)
+                out.push_back(at(i + j));
+        }
+        i += run;
+    }
+}
+
+const uint8_t* decodeXor(const uint8_t* in, uint8_t* out, size_t length, const uint8_t* inEnd) {
+    size_t i = 0;
+    while (i < length) {
+        if (inEnd && in >= inEnd)
+            return nullptr;
+        uint8_t control = *in++;
+        if (control < 0x80) {
+            i += control + 1;
+            continue;
+        }
+        size_t run = control - 0x7F;
+        if (i + run > length || (inEnd && in + run > inEnd))
+            return nullptr;
+        for (size_t j = 0; j < run; ++j)
+            out[i + j] ^= *in++;
+        i += run;
+    }
+    return in;
+}
+
+void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+bool readVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,23 @@
+#ifndef EMULATOR_ENCODING_H
+#define EMULATOR_ENCODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact byte encodings shared by the rewind buffer, movies and replay files
+
+// Run-length coding of the XOR of two buffers, or of one buffer when b is null. A control byte c < 0x80
+// stands for c + 1 zero bytes, c >= 0x80 is followed by c - 0x7F literal bytes.
+void encodeXor(const uint8_t* a, const uint8_t* b, size_t length, std::vector<uint8_t>& out);
+
+// XORs the decoded bytes into out, returns the end of the encoded data. Decoding stops at inEnd if
+// given, in which case nullptr is returned for truncated data.
+const uint8_t* decodeXor(const uint8_t* in, uint8_t* out, size_t length, const uint8_t* inEnd = nullptr);
+
+// LEB128 varints : 7 bits per byte, low bits first, high bit set on all bytes but the last
+void writeVarint(std::vector<uint8_t>& out, uint64_t value);
+// Advances in past the varint, false if it runs past end
+bool readVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value);
+
+#endif //EMULATOR_ENCODING_H
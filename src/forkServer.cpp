@@ -0,0 +1,172 @@
+#include "forkServer.h"
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+ForkServer::ForkServer(GameBoy& gb, const std::string& path, int slots)
+        : gameBoy(gb), socketPath(path), shmName("/tinyboy." + std::to_string(getpid())),
+          listenFd(-1), slotCount(slots), slots(nullptr) {
+
+    // Slots live in a named segment so that clients can map the results
+    int shmFd = shm_open(shmName.c_str(), O_CREAT | O_RDWR | O_EXCL, 0600);
+    if (shmFd < 0) {
+        std::cerr << "Error : unable to create shared memory : " << shmName << std::endl;
+        return;
+    }
+    size_t size = sizeof(WorkerSlot) * slotCount;
+    if (ftruncate(shmFd, size) != 0) {
+        std::cerr << "Error : unable to size shared memory : " << shmName << std::endl;
+        close(shmFd);
+        return;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    close(shmFd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error : unable to map shared memory : " << shmName << std::endl;
+        return;
+    }
+    this->slots = static_cast<WorkerSlot*>(mapping);
+    for (int i = 0; i < slotCount; ++i) {
+        new (&this->slots[i]) WorkerSlot();
+        this->slots[i].status = SLOT_FREE;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error : socket path too long : " << socketPath << std::endl;
+        return;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listenFd, 8) != 0) {
+        std::cerr << "Error : unable to listen on : " << socketPath << std::endl;
+        if (listenFd >= 0)
+            close(listenFd);
+        listenFd = -1;
+    }
+}
+
+ForkServer::~ForkServer() {
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    if (slots) {
+        munmap(slots, sizeof(WorkerSlot) * slotCount);
+        shm_unlink(shmName.c_str());
+    }
+}
+
+void ForkServer::serve() {
+    if (listenFd < 0 || !slots)
+        return;
+
+    // A client going away mid-reply must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+
+    // One client at a time : the next connection is accepted once the current one closes
+    std::cout << "Fork server listening on " << socketPath << " (" << shmName << ")" << std::endl;
+    while (gameBoy.running) {
+        int client = accept(listenFd, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        handleClient(client);
+        close(client);
+        reapWorkers();
+    }
+}
+
+void ForkServer::handleClient(int client) {
+    ForkHello hello{};
+    std::strncpy(hello.shmName, shmName.c_str(), sizeof(hello.shmName) - 1);
+    hello.slotCount = slotCount;
+    hello.slotSize = sizeof(WorkerSlot);
+    if (write(client, &hello, sizeof(hello)) != sizeof(hello))
+        return;
+
+    ForkRequest request;
+    while (read(client, &request, sizeof(request)) == sizeof(request)) {
+        reapWorkers();
+
+        ForkReply reply{-1, -1};
+        if (request.command == FORK_WORKER) {
+            reply = forkWorker(client, request.frames);
+        } else if (request.command == RELEASE_SLOT && request.slot < uint32_t(slotCount)) {
+            WorkerSlot& slot = slots[request.slot];
+            if (slot.status != SLOT_RUNNING) {
+                slot.status = SLOT_FREE;
+                reply.slot = int32_t(request.slot);
+            }
+        }
+
+        if (write(client, &reply, sizeof(reply)) != sizeof(reply))
+            return;
+    }
+}
+
+ForkReply ForkServer::forkWorker(int client, uint32_t frames) {
+    int index = 0;
+    while (index < slotCount && slots[index].status != SLOT_FREE)
+        index++;
+    if (index == slotCount)
+        return {-1, -1};
+
+    WorkerSlot& slot = slots[index];
+    slot.framesRequested = frames;
+    slot.framesDone = 0;
+    slot.cycles = 0;
+    slot.status = SLOT_RUNNING;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Worker : everything already loaded in the parent is shared copy-on-write. The sockets stay with the
+        // parent, or the client would not see its connection close until the last worker exits.
+        close(listenFd);
+        close(client);
+        runWorker(slot, frames);
+        _exit(0);
+    }
+    if (pid < 0) {
+        slot.status = SLOT_FREE;
+        return {-1, -1};
+    }
+
+    slot.pid = pid;
+    return {index, pid};
+}
+
+void ForkServer::runWorker(WorkerSlot& slot, uint32_t frames) {
+    uint64_t startCycles = gameBoy.totalCycles;
+    for (uint32_t i = 0; i < frames && gameBoy.running; ++i) {
+        // With frame skip, the last frame of a rollout is always drawn
+        if (i + 1 == frames)
+            gameBoy.ppu.requestRender();
+        gameBoy.runFrame();
+        if (gameBoy.ppu.renderingFrame())
+            std::memcpy(slot.frame, gameBoy.renderer.screenBuffer, sizeof(slot.frame));
+        slot.cycles = gameBoy.totalCycles - startCycles;
+        slot.framesDone.store(i + 1, std::memory_order_release);
+    }
+    slot.status.store(SLOT_DONE, std::memory_order_release);
+}
+
+void ForkServer::reapWorkers() {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < slotCount; ++i) {
+            // A worker that exited without finishing its rollout crashed
+            if (slots[i].pid == pid && slots[i].status == SLOT_RUNNING)
+                slots[i].status = SLOT_CRASHED;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef EMULATOR_FORKSERVER_H
+#define EMULATOR_FORKSERVER_H
+
+#include "gameBoy.h"
+#include <atomic>
+#include <string>
+#include <sys/types.h>
+
+// Wire protocol over the Unix socket. On connect the server sends a ForkHello,
+// then answers every ForkRequest with a ForkReply. Clients are served one at a time.
+enum ForkCommand : uint32_t {
+    FORK_WORKER = 0,
+    RELEASE_SLOT = 1
+};
+
+struct ForkHello {
+    char shmName[64];
+    uint32_t slotCount;
+    uint32_t slotSize;
+};
+
+struct ForkRequest {
+    uint32_t command;
+    uint32_t frames; // FORK_WORKER : frames to emulate in the child
+    uint32_t slot;   // RELEASE_SLOT : slot to give back
+};
+
+struct ForkReply {
+    int32_t slot; // -1 if no slot is free
+    int32_t pid;
+};
+
+enum SlotStatus : uint32_t {
+    SLOT_FREE = 0,
+    SLOT_RUNNING = 1,
+    SLOT_DONE = 2,
+    SLOT_CRASHED = 3
+};
+
+// One slot of the shared memory segment, written by the worker it was given to
+struct WorkerSlot {
+    std::atomic<uint32_t> status;
+    std::atomic<uint32_t> framesDone;
+    uint32_t framesRequested;
+    int32_t pid;
+    uint64_t cycles;
+    uint8_t frame[160*144]; // shades 0-3
+};
+
+class ForkServer {
+public:
+    ForkServer(GameBoy& gb, const std::string& socketPath, int slots = 64);
+    ~ForkServer();
+
+    void serve();
+
+private:
+    void handleClient(int client);
+    ForkReply forkWorker(int client, uint32_t frames);
+    void runWorker(WorkerSlot& slot, uint32_t frames);
+    void reapWorkers();
+
+    GameBoy& gameBoy;
+    std::string socketPath;
+    std::string shmName;
+    int listenFd;
+    int slotCount;
+    WorkerSlot* slots;
+};
+
+
+#endif //EMULATOR_FORKSERVER_H
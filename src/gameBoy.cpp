@@ -1,8 +1,20 @@
 #include "gameBoy.h"
+#include "movie.h"
+#include "rewind.h"
+#include "timeTravel.h"
 #include <fstream>
+#include <thread>
 
-GameBoy::GameBoy(const std::string& filepath) : renderer(memory), cpu(memory), ppu(memory, renderer),
-                            timer(memory), joypad(memory, renderer.window), running(true), pausing(false) {
+GameBoy::GameBoy(const std::string& filepath, bool headless, const std::string& exportName)
+        : sharedState(exportName.empty() ? nullptr : new SharedState(exportName)),
+          memory(sharedState ? sharedState->arena() : nullptr),
+          renderer(memory, headless, sharedState ? sharedState->screen() : nullptr), cpu(memory),
+          ppu(memory, renderer), timer(memory), joypad(memory, renderer.window), hasher(memory), debugger(*this),
+          cheats(memory), nextInputCycle(NO_INPUT_CHANGE), recorder(nullptr), rewind(nullptr), timeTravel(nullptr),
+          runAhead(0), headless(headless), running(true), pausing(false), totalCycles(0), frameCount(0), romHash(0) {
+    if (!headless)
+        setInput(std::unique_ptr<InputSource>(new KeyboardInput));
+    ppu.onVBlank = [this]() { onVBlank(); };
     setupSequence(filepath);
 }
 
@@ -12,27 +24,277 @@ void GameBoy::setupSequence(const std::string& filepath) {
 
 void GameBoy::loadCartridge(const std::string& filename) {
     memory.cart = loadRom(filename);
-    memory.cart->printInfo();
+    if (!memory.cart) {
+        running = false;
+        return;
+    }
+    memory.cart->attach(memory.pages);
+    romHash = hashBytes(memory.cart->rom(), memory.cart->romLength());
+    if (!headless)
+        memory.cart->printInfo();
+}
+
+void GameBoy::onVBlank() {
+    cheats.applyRamCodes();
+}
+
+void GameBoy::setInput(std::unique_ptr<InputSource> source) {
+    input = std::move(source);
+    nextInputCycle = input ? totalCycles : NO_INPUT_CHANGE;
+}
+
+void GameBoy::applyInput() {
+    uint8_t buttons = input->buttons(totalCycles);
+    if (recorder)
+        recorder->record(totalCycles, buttons);
+    if (timeTravel)
+        timeTravel->recordInput(totalCycles, buttons);
+    joypad.setButtons(buttons);
+    joypad.update();
+    nextInputCycle = input->nextChange(totalCycles);
+}
+
+int GameBoy::step() {
+    if (totalCycles >= nextInputCycle)
+        applyInput();
+    if (timeTravel && totalCycles >= timeTravel->nextCapture)
+        timeTravel->capture();
+
+    interruptStep(cpu);
+    int cycles = cpu.step();
+    totalCycles += cycles;
+
+    if (ppu.lcdOn)
+        ppu.step(cycles);
+    else
+        ppu.idle(cycles);
+    timer.step(cycles);
+
+    return cycles;
+}
+
+void GameBoy::runFrame() {
+    bool exporting = sharedState && sharedState->valid();
+    if (exporting)
+        sharedState->beginFrame();
+
+    if (input) {
+        input->poll(totalCycles);
+        applyInput();
+    } else {
+        joypad.update();
+    }
+    ppu.frameComplete = false;
+    while (running && !ppu.frameComplete) {
+        // The prompt comes before the instruction, and going back in time may land at the end of a frame
+        if (pausing) {
+            debugger.prompt();
+            if (!running || ppu.frameComplete)
+                break;
+        }
+        step();
+    }
+    frameCount++;
+
+    frameDirty = memory.dirty;
+    memory.dirty.clear();
+    if (memory.cart) {
+        frameRamDirty = memory.cart->ramDirty;
+        memory.cart->ramDirty.clear();
+    }
+    hasher.addDirty(frameDirty, frameRamDirty);
+    if (recorder)
+        recorder->endFrame();
+
+    if (exporting)
+        sharedState->endFrame(frameCount);
+}
+
+void GameBoy::runFrames(int n) {
+    for (int i = 0; i < n && running; ++i)
+        runFrame();
+}
+
+GameBoy::Detached::Detached(GameBoy& gameBoy) : gameBoy(gameBoy), input(std::move(gameBoy.input)),
+        recorder(gameBoy.recorder), timeTravel(gameBoy.timeTravel), onWatch(std::move(gameBoy.memory.onWatch)),
+        silent(gameBoy.ppu.silent) {
+    gameBoy.recorder = nullptr;
+    gameBoy.timeTravel = nullptr;
+    gameBoy.memory.onWatch = nullptr;
+}
+
+GameBoy::Detached::~Detached() {
+    gameBoy.ppu.silent = silent;
+    gameBoy.setInput(std::move(input));
+    gameBoy.recorder = recorder;
+    gameBoy.timeTravel = timeTravel;
+    gameBoy.memory.onWatch = std::move(onWatch);
+}
+
+void GameBoy::runDetachedFrame(uint8_t buttons) {
+    Detached detached(*this);
+    std::unique_ptr<ScriptedInput> fixed(new ScriptedInput);
+    fixed->schedule(totalCycles, buttons);
+    setInput(std::move(fixed));
+    runFrame();
+}
+
+void GameBoy::runFrameAhead() {
+    if (!aheadState)
+        aheadState.reset(new Snapshot);
+
+    ppu.silent = true;
+    runFrame();
+    if (!running || !saveState(*aheadState)) {
+        ppu.silent = false;
+        return;
+    }
+    AddressDirtyMap dirty = frameDirty;
+    RamDirtyMap ramDirty = frameRamDirty;
+
+    // Throwaway frames with the buttons of this one, only the last is drawn
+    for (int i = 1; i <= runAhead && running; ++i) {
+        ppu.silent = i < runAhead;
+        runDetachedFrame(aheadState->joypad.pressed);
+    }
+    ppu.silent = false;
+    renderer.renderScreen();
+
+    loadState(*aheadState);
+    frameDirty = dirty;
+    frameRamDirty = ramDirty;
+}
+
+uint64_t GameBoy::stateHash() {
+    if (!memory.cart)
+        return 0;
+    hasher.addDirty(memory.dirty, memory.cart->ramDirty);
+
+    // Registers, counters and banking are small enough to be hashed in full
+    struct {
+        Registers regs;
+        uint32_t bank;
+        int ppuMode, ppuCycles, divCycles, timaCycles;
+        bool IME;
+    } core;
+    std::memset(&core, 0, sizeof(core));
+    core.regs = cpu.regs;
+    core.bank = memory.cart->bankState();
+    ppu.catchUpIdle();
+    core.ppuMode = ppu.mode;
+    core.ppuCycles = ppu.internalCycles;
+    core.divCycles = timer.divCounter();
+    core.timaCycles = timer.timaCounter();
+    core.IME = memory.IME;
+
+    return hasher.value() ^ hashBytes(&core, sizeof(core), 0x10000);
+}
+
+bool GameBoy::saveState(Snapshot& state) {
+    if (!memory.cart)
+        return false;
+    if (uint32_t(memory.cart->ramLength()) > SNAPSHOT_MAX_CART_RAM) {
+        std::cerr << "Cartridge RAM too large for a save state" << std::endl;
+        return false;
+    }
+
+    // Zeroes the padding too, so equal states have equal bytes
+    std::memset(&state, 0, offsetof(Snapshot, arena));
+    std::memcpy(state.magic, "TBSN", 4);
+    state.version = SNAPSHOT_VERSION;
+    state.romHash = romHash;
+    state.totalCycles = totalCycles;
+    state.frameCount = frameCount;
+
+    state.regs = cpu.regs;
+    state.IME = memory.IME;
+    state.bankState = memory.cart->bankState();
+    ppu.saveState(state.ppu);
+    state.divCycles = timer.divCounter();
+    state.timaCycles = timer.timaCounter();
+    joypad.saveState(state.joypad);
+
+    state.arena = *memory.arena;
+    state.cartRamSize = memory.cart->ramLength();
+    if (state.cartRamSize)
+        std::memcpy(state.cartRam, memory.cart->ram(), state.cartRamSize);
+    std::memset(state.cartRam + state.cartRamSize, 0, SNAPSHOT_MAX_CART_RAM - state.cartRamSize);
+    std::memcpy(state.screen, renderer.screenBuffer, sizeof(state.screen));
+    return true;
+}
+
+bool GameBoy::loadState(const Snapshot& state) {
+    if (std::memcmp(state.magic, "TBSN", 4) != 0 || state.version != SNAPSHOT_VERSION) {
+        std::cerr << "Unsupported save state" << std::endl;
+        return false;
+    }
+    if (!memory.cart || state.romHash != romHash || int(state.cartRamSize) != memory.cart->ramLength()) {
+        std::cerr << "Save state was made with another ROM" << std::endl;
+        return false;
+    }
+
+    totalCycles = state.totalCycles;
+    frameCount = state.frameCount;
+
+    cpu.regs = state.regs;
+    memory.IME = state.IME;
+    *memory.arena = state.arena;
+    if (state.cartRamSize)
+        std::memcpy(memory.cart->ram(), state.cartRam, state.cartRamSize);
+    memory.cart->restoreBankState(state.bankState);
+    ppu.loadState(state.ppu);
+    timer.restore(state.divCycles, state.timaCycles);
+    joypad.loadState(state.joypad);
+    std::memcpy(renderer.screenBuffer, state.screen, sizeof(state.screen));
+
+    // Anything may have changed
+    for (int page = 0; page < 256; ++page)
+        memory.dirty.markPage(page);
+    for (uint32_t page = 0; page < state.cartRamSize / 256; ++page)
+        memory.cart->ramDirty.markPage(page);
+    hasher.invalidate();
+    nextInputCycle = input ? totalCycles : NO_INPUT_CHANGE;
+    return true;
 }
 
 void GameBoy::run() {
 
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    uint64_t totalTicks = 0;
+    uint64_t startCycles = totalCycles;
     while(running) {
 
-        renderer.callback(running);
+        if (rewind && sf::Keyboard::isKeyPressed(sf::Keyboard::Backspace)) {
+            rewind->stepBack();
+            renderer.renderScreen();
+            renderer.callback(running);
 
-        joypad.checkState();
-        interruptStep(cpu);
-        int cycles = cpu.step();
-        totalTicks += cycles;
+            // Rewinds at the normal frame rate, then paces again from the restored cycle count
+            std::this_thread::sleep_for(std::chrono::nanoseconds(uint64_t(70224 * 238.418579)));
+            start = std::chrono::steady_clock::now();
+            startCycles = totalCycles;
+            continue;
+        }
 
-        ppu.step(cycles);
-        timer.step(cycles);
+        if (runAhead > 0)
+            runFrameAhead();
+        else
+            runFrame();
+        if (rewind)
+            rewind->capture();
+
+        // Host events are only looked at once per frame, like the keyboard
+        renderer.callback(running);
 
-        while (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()
-                < totalTicks * 238.418579) {}
+        // One cycle lasts 238.418579 ns. After a stall (debugger, slow host) don't try to catch up.
+        std::chrono::steady_clock::time_point target = start + std::chrono::nanoseconds(
+                uint64_t((totalCycles - startCycles) * 238.418579));
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now > target + std::chrono::milliseconds(100)) {
+            start = now;
+            startCycles = totalCycles;
+        } else {
+            std::this_thread::sleep_until(target);
+        }
 
     }
     std::cout << "End" << std::endl;
@@ -7,30 +7,91 @@
 #include "display.h"
 #include "timer.h"
 #include "joypad.h"
+#include "stateHash.h"
+#include "debugger.h"
+#include "cheats.h"
+#include "sharedState.h"
+#include "inputSource.h"
+#include "snapshot.h"
 #include <string>
 #include <chrono>
 
 
+class Rewind;
+class TimeTravel;
+
 class GameBoy {
 public:
-    GameBoy(const std::string& filepath);
+    GameBoy(const std::string& filepath, bool headless = false, const std::string& exportName = "");
     void run();
+    int step();
+    void runFrame();
+    void runFrames(int n);
+    // Runs a frame holding the given buttons, detached from the input source and the recorders
+    void runDetachedFrame(uint8_t buttons);
+    // Emulates one frame but shows the one runAhead frames later, then comes back
+    void runFrameAhead();
+    uint64_t stateHash();
+    void setInput(std::unique_ptr<InputSource> source);
+
+    // Save states. loadState reports why a snapshot does not fit on std::cerr.
+    bool saveState(Snapshot& state);
+    bool loadState(const Snapshot& state);
+
+    // Takes the input source, the recorder, the time travel history and the watch hook away while frames
+    // that did not happen (or already happened) are emulated, and gives them back with the silent flag
+    class Detached {
+    public:
+        explicit Detached(GameBoy& gameBoy);
+        ~Detached();
+        Detached(const Detached&) = delete;
+        Detached& operator=(const Detached&) = delete;
+
+    private:
+        GameBoy& gameBoy;
+        std::unique_ptr<InputSource> input;
+        InputRecorder* recorder;
+        TimeTravel* timeTravel;
+        std::function<void(uint16_t address, uint8_t type)> onWatch;
+        bool silent;
+    };
 
 private:
     void setupSequence(const std::string& filepath);
     void loadCartridge(const std::string& filename);
+    void onVBlank();
+    void applyInput();
 
 public:
+    std::unique_ptr<SharedState> sharedState;
     Memory memory;
     Display renderer;
     CPU cpu;
     PPU ppu;
     Timer timer;
     Joypad joypad;
+    StateHash hasher;
+    Debugger debugger;
+    Cheats cheats;
+    std::unique_ptr<InputSource> input;
+    uint64_t nextInputCycle;
+    InputRecorder* recorder;
+    Rewind* rewind; // held with backspace
+    TimeTravel* timeTravel; // set by the debugger
+    int runAhead;
+    std::unique_ptr<Snapshot> aheadState;
+
+    // Pages written during the last frame
+    AddressDirtyMap frameDirty;
+    RamDirtyMap frameRamDirty;
 
+    bool headless;
     bool running;
     bool pausing;
     int prevCycles;
+    uint64_t totalCycles;
+    uint64_t frameCount;
+    uint64_t romHash;
 };
 
 
@@ -0,0 +1,40 @@
+#include "inputSource.h"
+#include "joypad.h"
+
+void KeyboardInput::poll(uint64_t cycle) {
+    uint8_t state = 0;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::A))
+        state |= A;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::B))
+        state |= B;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Delete))
+        state |= SELECT;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Enter))
+        state |= START;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right))
+        state |= RIGHT;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left))
+        state |= LEFT;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up))
+        state |= UP;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down))
+        state |= DOWN;
+    this->state = state;
+}
+
+void ScriptedInput::poll(uint64_t cycle) {
+    if (script)
+        script(*this, cycle);
+}
+
+uint8_t ScriptedInput::buttons(uint64_t cycle) {
+    auto next = changes.upper_bound(cycle);
+    if (next == changes.begin())
+        return 0;
+    return std::prev(next)->second;
+}
+
+uint64_t ScriptedInput::nextChange(uint64_t cycle) {
+    auto next = changes.upper_bound(cycle);
+    return next == changes.end() ? NO_INPUT_CHANGE : next->first;
+}
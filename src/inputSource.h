@@ -0,0 +1,62 @@
+#ifndef EMULATOR_INPUTSOURCE_H
+#define EMULATOR_INPUTSOURCE_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+constexpr uint64_t NO_INPUT_CHANGE = UINT64_MAX;
+
+// Where the buttons (JOYPAD_INPUT bits) come from. Changes are scheduled at cycle timestamps, so a
+// scripted or replayed run presses the same buttons at the same instruction every time.
+class InputSource {
+public:
+    virtual ~InputSource() = default;
+
+    // Called at the start of every frame, e.g. to sample the host
+    virtual void poll(uint64_t cycle) {}
+    // Buttons held at cycle
+    virtual uint8_t buttons(uint64_t cycle) = 0;
+    // First cycle after `cycle` where the buttons change, NO_INPUT_CHANGE if none is known yet
+    virtual uint64_t nextChange(uint64_t cycle) = 0;
+};
+
+class KeyboardInput : public InputSource {
+public:
+    void poll(uint64_t cycle) override;
+    uint8_t buttons(uint64_t cycle) override { return state; }
+    uint64_t nextChange(uint64_t cycle) override { return NO_INPUT_CHANGE; }
+
+private:
+    uint8_t state = 0;
+};
+
+// Changes scheduled up front, or by a script called every frame
+class ScriptedInput : public InputSource {
+public:
+    using Script = std::function<void(ScriptedInput& input, uint64_t cycle)>;
+
+    explicit ScriptedInput(Script script = nullptr) : script(std::move(script)) {}
+
+    void schedule(uint64_t cycle, uint8_t buttons) { changes[cycle] = buttons; }
+
+    void poll(uint64_t cycle) override;
+    uint8_t buttons(uint64_t cycle) override;
+    uint64_t nextChange(uint64_t cycle) override;
+
+protected:
+    std::map<uint64_t, uint8_t> changes;
+    Script script;
+};
+
+// Told about every button change applied to the joypad, and about the end of every frame
+class InputRecorder {
+public:
+    virtual ~InputRecorder() = default;
+
+    virtual void record(uint64_t cycle, uint8_t buttons) = 0;
+    virtual void endFrame() = 0;
+};
+
+#endif //EMULATOR_INPUTSOURCE_H
@@ -4,6 +4,7 @@
 #include "memory.h"
 #include "interrupts.h"
 #include <SFML/Window.hpp>
+#include <atomic>
 
 enum JOYPAD_INPUT : uint8_t {
     A = (1 << 0),
@@ -16,17 +17,32 @@ enum JOYPAD_INPUT : uint8_t {
     DOWN = (1 << 7)
 };
 
+struct JoypadState {
+    uint8_t pressed;
+    uint8_t previousState;
+};
+
 class Joypad {
 public:
-    Joypad(Memory& mem, sf::Window& win) : memory(mem), window(win), previousState(0xFF) {}
+    Joypad(Memory& mem, sf::Window& win);
 
-    void checkState();
+    // Pressed buttons (JOYPAD_INPUT bits). Can be set from any thread, the emulation applies it with update.
+    void setButtons(uint8_t pressed) { buttons.store(pressed, std::memory_order_relaxed); }
+    void update();
+
+    // Recomputes JOYP, when the game selects a button group or the pressed buttons change
+    void refresh();
     bool checkButtonPressed(uint8_t newState);
 
+    void saveState(JoypadState& state) const;
+    void loadState(const JoypadState& state);
+
 private:
     Memory& memory;
     sf::Window& window;
 
+    std::atomic<uint8_t> buttons;
+    uint8_t pressed;
     uint8_t previousState;
 };
 
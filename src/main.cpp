@@ -1,12 +1,275 @@
 #include "gameBoy.h"
+#include "movie.h"
+#include "rewind.h"
+#include "replay.h"
+#include "stateArchive.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include "forkServer.h"
+#endif
 
+// Starts from the state of an archive with the given key, the state hash it was saved with
+static bool loadArchivedState(GameBoy& gameBoy, const std::string& path, const std::string& key) {
+    StateArchive archive;
+    if (!archive.open(path))
+        return false;
+    const ArchiveRecord* record = archive.find(std::stoull(key, nullptr, 16));
+    if (!record) {
+        std::cerr << "No state " << key << " in " << path << std::endl;
+        return false;
+    }
+    std::unique_ptr<Snapshot> state(new Snapshot);
+    return archive.load(*record, *state) && gameBoy.loadState(*state);
+}
 
 int main(int argc, char** argv)
 {
+    if (argc < 2) {
+        std::cerr << "Usage : " << argv[0] << " [path/to/rom] [--palette green|grey|purple] [--debug] [--cheat code]..."
+                  << " [--export shm-name] [--fork-server socket] [--advance frames]"
+                  << " [--frame-skip n] [--render-thread] [--rewind] [--run-ahead 1-3] [--movie file] [--record file]"
+                  << " [--verify file] [--frames n] [--record-replay file] [--replay file] [--seek frame]"
+                  << " [--verify-replay file] [--threads n] [--archive file] [--load-state file key]" << std::endl;
+        return 1;
+    }
+
     std::string filepath1 = std::string{argv[1]};
-    GameBoy emulation(filepath1.c_str());
+    std::string forkSocket;
+    std::string exportName;
+    int advance = 0;
+    int frameSkip = 0;
+    int frames = 0;
+    int runAhead = 0;
+    uint64_t seekFrame = 0;
+    unsigned threads = 0;
+    std::string moviePath;
+    std::string recordPath;
+    std::string verifyPath;
+    std::string replayPath;
+    std::string recordReplayPath;
+    std::string verifyReplayPath;
+    std::string archivePath;
+    std::string statePath;
+    std::string stateKey;
+    bool debug = false;
+    bool renderThread = false;
+    bool rewind = false;
+    std::string palette = "green";
+    std::vector<std::string> cheats;
+    for (int i = 2; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--fork-server" && i + 1 < argc)
+            forkSocket = argv[++i];
+        else if (option == "--advance" && i + 1 < argc)
+            advance = std::stoi(argv[++i]);
+        else if (option == "--frame-skip" && i + 1 < argc)
+            frameSkip = std::stoi(argv[++i]);
+        else if (option == "--debug")
+            debug = true;
+        else if (option == "--render-thread")
+            renderThread = true;
+        else if (option == "--rewind")
+            rewind = true;
+        else if (option == "--run-ahead" && i + 1 < argc)
+            runAhead = std::min(std::max(std::stoi(argv[++i]), 0), 3);
+        else if (option == "--palette" && i + 1 < argc)
+            palette = argv[++i];
+        else if (option == "--export" && i + 1 < argc)
+            exportName = argv[++i];
+        else if (option == "--cheat" && i + 1 < argc)
+            cheats.emplace_back(argv[++i]);
+        else if (option == "--movie" && i + 1 < argc)
+            moviePath = argv[++i];
+        else if (option == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (option == "--verify" && i + 1 < argc)
+            verifyPath = argv[++i];
+        else if (option == "--frames" && i + 1 < argc)
+            frames = std::stoi(argv[++i]);
+        else if (option == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (option == "--record-replay" && i + 1 < argc)
+            recordReplayPath = argv[++i];
+        else if (option == "--seek" && i + 1 < argc)
+            seekFrame = std::stoull(argv[++i]);
+        else if (option == "--verify-replay" && i + 1 < argc)
+            verifyReplayPath = argv[++i];
+        else if (option == "--threads" && i + 1 < argc)
+            threads = unsigned(std::stoi(argv[++i]));
+        else if (option == "--archive" && i + 1 < argc)
+            archivePath = argv[++i];
+        else if (option == "--load-state" && i + 2 < argc) {
+            statePath = argv[++i];
+            stateKey = argv[++i];
+        }
+    }
+
+    // Recorders only go forward, a rewound frame would be recorded twice
+    if (rewind && (!recordPath.empty() || !recordReplayPath.empty())) {
+        std::cerr << "--rewind cannot be combined with --record or --record-replay" << std::endl;
+        return 1;
+    }
+    if (!recordPath.empty() && !recordReplayPath.empty()) {
+        std::cerr << "--record and --record-replay cannot be used together" << std::endl;
+        return 1;
+    }
+
+    Movie movie;
+    if (!moviePath.empty() && !movie.load(moviePath))
+        return 1;
+    ReplayFile replay;
+    if (!replayPath.empty() && !replay.open(replayPath))
+        return 1;
+
+    // Checks every segment between two keyframes of a replay at the same time
+    if (!verifyReplayPath.empty()) {
+        ReplayFile recorded;
+        if (!recorded.open(verifyReplayPath))
+            return 1;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!verifyReplay(filepath1, recorded, threads))
+            return 1;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Replay verified : " << recorded.frames() << " frames in " << elapsed.count() << " ms"
+                  << std::endl;
+        return 0;
+    }
+
+    // Jumps to a frame of a replay and prints the state there
+    if (!replayPath.empty() && frames > 0) {
+        GameBoy emulation(filepath1, true);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!replay.seek(emulation, uint64_t(frames)))
+            return 1;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Frame " << frames << " of " << replay.frames() << " reached in " << elapsed.count()
+                  << " ms, state hash " << std::hex << emulation.stateHash() << std::dec << std::endl;
+        return 0;
+    }
+
+    // Replays a movie at full speed and checks that it still ends up in the recorded states
+    if (!verifyPath.empty()) {
+        Movie recorded;
+        if (!recorded.load(verifyPath))
+            return 1;
+        GameBoy emulation(filepath1, true);
+        for (const std::string& code : cheats)
+            emulation.cheats.add(code);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!verifyPlayback(emulation, recorded))
+            return 1;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Movie verified : " << recorded.frames << " frames in " << elapsed.count() << " ms" << std::endl;
+        return 0;
+    }
+
+    // Headless run at full speed, e.g. for benchmarks and regression checks
+    if (frames > 0) {
+        GameBoy emulation(filepath1, true, exportName);
+        emulation.ppu.frameSkip = frameSkip;
+        for (const std::string& code : cheats)
+            emulation.cheats.add(code);
+        if (!statePath.empty() && !loadArchivedState(emulation, statePath, stateKey))
+            return 1;
+        if (!moviePath.empty() && !startPlayback(emulation, movie))
+            return 1;
+        std::unique_ptr<MovieRecorder> recorder;
+        if (!recordPath.empty()) {
+            recorder.reset(new MovieRecorder(emulation));
+            emulation.recorder = recorder.get();
+        }
+        std::unique_ptr<ReplayRecorder> replayRecorder;
+        if (!recordReplayPath.empty()) {
+            replayRecorder.reset(new ReplayRecorder(emulation, recordReplayPath));
+            emulation.recorder = replayRecorder.get();
+        }
+
+        // Keeps the state after every frame, keyed by its hash
+        std::unique_ptr<ArchiveWriter> archive;
+        std::unique_ptr<Snapshot> state;
+        if (!archivePath.empty()) {
+            archive.reset(new ArchiveWriter(archivePath, emulation.romHash));
+            state.reset(new Snapshot);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (archive) {
+            for (int i = 0; i < frames && emulation.running; ++i) {
+                emulation.runFrame();
+                if (emulation.saveState(*state))
+                    archive->add(emulation.stateHash(), *state);
+            }
+        } else {
+            emulation.runFrames(frames);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << emulation.frameCount << " frames in " << elapsed.count() << " ms, state hash "
+                  << std::hex << emulation.stateHash() << std::dec << std::endl;
+        if (archive) {
+            std::cout << archive->states() << " states archived in " << archive->blobs() << " sections" << std::endl;
+            if (!archive->close())
+                return 1;
+        }
+        return (recorder && !recorder->movie().save(recordPath)) ? 1 : 0;
+    }
+
+    if (!forkSocket.empty()) {
+#if defined(__unix__) || defined(__APPLE__)
+        GameBoy emulation(filepath1, true);
+        emulation.ppu.frameSkip = frameSkip;
+        for (const std::string& code : cheats)
+            emulation.cheats.add(code);
+        emulation.runFrames(advance);
+        ForkServer server(emulation, forkSocket);
+        server.serve();
+#else
+        std::cerr << "Fork server is only available on Unix" << std::endl;
+#endif
+        return 0;
+    }
+
+    GameBoy emulation(filepath1, false, exportName);
+    if (palette == "grey")
+        emulation.renderer.setPalette(PALETTE_GREY);
+    else if (palette == "purple")
+        emulation.renderer.setPalette(PALETTE_PURPLE);
+    emulation.ppu.frameSkip = frameSkip;
+    emulation.ppu.setRenderThread(renderThread);
+    emulation.runAhead = runAhead;
+    for (const std::string& code : cheats)
+        emulation.cheats.add(code);
+    if (!statePath.empty() && !loadArchivedState(emulation, statePath, stateKey))
+        return 1;
+    if (!moviePath.empty() && !startPlayback(emulation, movie))
+        return 1;
+    // The keyboard takes over from where the replay was sought to
+    if (!replayPath.empty()) {
+        if (!replay.seek(emulation, seekFrame))
+            return 1;
+        emulation.setInput(std::unique_ptr<InputSource>(new KeyboardInput));
+    }
+    std::unique_ptr<MovieRecorder> recorder;
+    if (!recordPath.empty()) {
+        recorder.reset(new MovieRecorder(emulation));
+        emulation.recorder = recorder.get();
+    }
+    std::unique_ptr<ReplayRecorder> replayRecorder;
+    if (!recordReplayPath.empty()) {
+        replayRecorder.reset(new ReplayRecorder(emulation, recordReplayPath));
+        emulation.recorder = replayRecorder.get();
+    }
+    std::unique_ptr<Rewind> history;
+    if (rewind) {
+        history.reset(new Rewind(emulation));
+        emulation.rewind = history.get();
+    }
+    if (debug) {
+        emulation.debugger.attach();
+        emulation.pausing = true;
+    }
     emulation.run();
 
+    if (recorder && !recorder->movie().save(recordPath))
+        return 1;
     return 0;
 }
-
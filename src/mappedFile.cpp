@@ -0,0 +1,65 @@
+#include "mappedFile.h"
+#include <fstream>
+#include <iostream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Error : unable to open file : " << path << std::endl;
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    length = size_t(info.st_size);
+    if (length == 0) {
+        ::close(fd);
+        bytes = buffer.data();
+        return true;
+    }
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error : unable to map file : " << path << std::endl;
+        length = 0;
+        return false;
+    }
+    bytes = static_cast<const uint8_t*>(mapping);
+    mapped = true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "Error : unable to open file : " << path << std::endl;
+        return false;
+    }
+    buffer.resize(size_t(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(buffer.size()));
+    bytes = buffer.data();
+    length = buffer.size();
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped)
+        munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+    mapped = false;
+    bytes = nullptr;
+    length = 0;
+    buffer.clear();
+}
@@ -1,13 +1,58 @@
 #include "memory.h"
 
 // Fetch Memory
+uint8_t Memory::peek(uint16_t address) const {
+    uint8_t index = address >> 8;
+    if (pages.readBacking[index])
+        return pages.readBacking[index][address & 0xFF];
+
+    if (address >= 0x8000 && address < 0xA000)
+        return VRAM[address - 0x8000];
+    if (address >= 0xC000 && address < 0xE000)
+        return WRAM[address - 0xC000];
+    if (address >= 0xFE00 && address < 0xFEA0)
+        return OAM[address - 0xFE00];
+    if (address >= 0xFF00 && address < 0xFF80)
+        return IORegisters[address - 0xFF00];
+    if (address >= 0xFF80 && address < 0xFFFF)
+        return HRAM[address - 0xFF80];
+    if (address == 0xFFFF)
+        return IE_;
+    return (address < 0x8000 || (address >= 0xA000 && address < 0xC000)) ? 0xFF : 0;
+}
+
 uint16_t Memory::read16(uint16_t address) {
     uint8_t lsb = read8(address);
     uint8_t msb = read8(address+1);
     return (uint16_t(msb) << 8) + lsb;
 }
 
+uint8_t Memory::fetch8(uint16_t address) {
+    uint8_t* page = pages.fetch[address >> 8];
+    if (page)
+        return page[address & 0xFF];
+    return fetchSlow(address);
+}
+
+uint8_t Memory::fetchSlow(uint16_t address) {
+    if (pages.watched[address >> 8] & WATCH_EXECUTE)
+        checkWatch(address, WATCH_EXECUTE);
+    return read8(address);
+}
+
 uint8_t Memory::read8(uint16_t address) {
+    uint8_t* page = pages.read[address >> 8];
+    if (page)
+        return page[address & 0xFF];
+    return readSlow(address);
+}
+
+uint8_t Memory::readSlow(uint16_t address) {
+    uint8_t index = address >> 8;
+    if (pages.watched[index] & WATCH_READ)
+        checkWatch(address, WATCH_READ);
+    if (pages.readBacking[index])
+        return pages.readBacking[index][address & 0xFF];
 
     uint8_t val = 0;
     if(address < 0x8000) { // ROM
@@ -39,10 +84,40 @@ void Memory::write16(uint16_t address, uint16_t value) {
 }
 
 void Memory::write8(uint16_t address, uint8_t value) {
+    dirty.mark(address);
+    uint8_t* page = pages.write[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
+        return;
+    }
+    writeSlow(address, value);
+}
+
+// LCDC, SCY, SCX, BGP, OBP0, OBP1, WY and WX
+static bool videoRegister(uint16_t address) {
+    switch (address) {
+        case 0xFF40: case 0xFF42: case 0xFF43: case 0xFF47:
+        case 0xFF48: case 0xFF49: case 0xFF4A: case 0xFF4B:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Memory::writeSlow(uint16_t address, uint8_t value) {
+    uint8_t index = address >> 8;
+    if (pages.watched[index] & WATCH_WRITE)
+        checkWatch(address, WATCH_WRITE);
+    if (pages.writeBacking[index]) {
+        pages.writeBacking[index][address & 0xFF] = value;
+        return;
+    }
 
     if(address < 0x8000) { // ROM
         cart->writeCart(address, value);
     } else if (address < 0xA000) { // VRAM
+        if (onVideoWrite && VRAM[address - 0x8000] != value)
+            onVideoWrite(address, value);
         VRAM[address - 0x8000] = value;
     } else if (address < 0xC000) { // extern RAM
         cart->writeCart(address, value);
@@ -50,12 +125,18 @@ void Memory::write8(uint16_t address, uint8_t value) {
         WRAM[address - 0xC000] = value;
     } else if (address < 0xFE00) { // unused
     } else if (address < 0xFEA0) { // OAM
+        if (onVideoWrite && OAM[address - 0xFE00] != value)
+            onVideoWrite(address, value);
         OAM[address - 0xFE00] = value;
     } else if (address < 0xFF00) { // unused
     } else if (address == 0xFF46) { // DMA Transfer
         DMATransfer(value);
     } else if (address < 0xFF80) { // I/O Registers
+        if (onVideoWrite && videoRegister(address) && IORegisters[address - 0xFF00] != value)
+            onVideoWrite(address, value);
         IORegisters[address - 0xFF00] = value;
+        if (address == 0xFF00 && onJoypadWrite)
+            onJoypadWrite();
     } else if (address < 0xFFFE) { // HRAM
         HRAM[address - 0xFF80] = value;
     } else if (address == 0xFFFF) { // IME
@@ -70,3 +151,27 @@ void Memory::DMATransfer(uint16_t startAddress) {
         write8(addressDest, read8(addressSource));
     }
 }
+
+void Memory::addWatch(uint16_t start, uint16_t end, uint8_t type) {
+    watchpoints.push_back({start, end, type});
+    for (int page = start >> 8; page <= end >> 8; ++page)
+        pages.setWatched(page, pages.watched[page] | type);
+}
+
+void Memory::clearWatches() {
+    watchpoints.clear();
+    for (int page = 0; page < 256; ++page)
+        if (pages.watched[page])
+            pages.setWatched(page, 0);
+}
+
+void Memory::checkWatch(uint16_t address, uint8_t type) {
+    if (!onWatch)
+        return;
+    for (const Watchpoint& watch : watchpoints) {
+        if ((watch.type & type) && address >= watch.start && address <= watch.end) {
+            onWatch(address, type);
+            return;
+        }
+    }
+}
@@ -2,38 +2,91 @@
 #define EMULATOR_MEMORY_H
 
 #include "cartridge.h"
+#include "dirtyMap.h"
+#include "pageTable.h"
 #include <cstring>
 #include <memory>
+#include <functional>
+#include <vector>
+
+// Guest RAM and registers, kept in one block so that it can be placed anywhere (see SharedState)
+struct MemoryArena {
+    uint8_t VRAM[0x2000];
+    uint8_t WRAM[0x2000];
+    uint8_t OAM[0xA0];
+    uint8_t IORegisters[0x80];
+    uint8_t HRAM[0x7F];
+    uint8_t IE_;
+};
 
 struct Memory {
 
-    Memory() {
+    Memory(MemoryArena* external = nullptr) : ownedArena(external ? nullptr : new MemoryArena),
+            arena(external ? external : ownedArena.get()), VRAM(arena->VRAM), WRAM(arena->WRAM), OAM(arena->OAM),
+            IORegisters(arena->IORegisters), HRAM(arena->HRAM), IE_(arena->IE_) {
         std::memset(VRAM, 0, 0x2000);
         std::memset(WRAM, 0, 0x2000);
         std::memset(OAM, 0, 0xA0);
         std::memset(IORegisters, 0, 0x80);
         std::memset(HRAM, 0, 0x7F);
         JOYP() = 0xCF;
+        LCDC() = 0x91; // as left by the boot ROM
         IE_ = 0x00;
         IME = false;
+
+        // VRAM writes go through the slow path so the PPU hears about them
+        for (int page = 0; page < 0x20; ++page) {
+            pages.mapRead(0x80 + page, &VRAM[page << 8]);
+            pages.mapRead(0xC0 + page, &WRAM[page << 8]);
+            pages.mapWrite(0xC0 + page, &WRAM[page << 8]);
+        }
     }
 
     std::unique_ptr<Cartridge> cart; // 0x0000 - 0x7FFF
-    uint8_t VRAM[0x2000]; // 0x8000 - 0x9FFF
-    uint8_t WRAM[0x2000]; // 0xC000 - 0xDFFF
-    uint8_t OAM[0xA0]; // 0xFE00 - 0xFE9F
-    uint8_t IORegisters[0x80]; // 0xFF00 - 0xFF7F
-    uint8_t HRAM[0x7F]; // 0xFF80 - 0xFFFE
-    uint8_t IE_; // 0xFFFF
+    std::unique_ptr<MemoryArena> ownedArena;
+    MemoryArena* arena;
+    uint8_t (&VRAM)[0x2000]; // 0x8000 - 0x9FFF
+    uint8_t (&WRAM)[0x2000]; // 0xC000 - 0xDFFF
+    uint8_t (&OAM)[0xA0]; // 0xFE00 - 0xFE9F
+    uint8_t (&IORegisters)[0x80]; // 0xFF00 - 0xFF7F
+    uint8_t (&HRAM)[0x7F]; // 0xFF80 - 0xFFFE
+    uint8_t& IE_; // 0xFFFF
     bool IME;
 
+    // Pages written through write8 since the last clear. I/O registers are also
+    // modified directly by the PPU, timer and joypad, so page 0xFF is never reliable.
+    AddressDirtyMap dirty;
+
+    PageTable pages;
+
+    // Called before a write that changes VRAM, OAM or a register the PPU draws with
+    std::function<void(uint16_t address, uint8_t value)> onVideoWrite;
+
+    // Called after the game writes the select bits of JOYP
+    std::function<void()> onJoypadWrite;
+
     void DMATransfer(uint16_t startAddress);
 
     // fetch, read, write
+    uint8_t fetch8(uint16_t address);
     uint8_t read8(uint16_t address);
     uint16_t read16(uint16_t address);
     void write8(uint16_t address, uint8_t value);
     void write16(uint16_t address, uint16_t value);
+    // For the debugger : no watchpoint, no cartridge call. Unmapped cartridge pages read 0xFF.
+    uint8_t peek(uint16_t address) const;
+
+    // Watchpoints : only the pages they cover leave the fast path
+    struct Watchpoint {
+        uint16_t start;
+        uint16_t end;
+        uint8_t type;
+    };
+    std::vector<Watchpoint> watchpoints;
+    std::function<void(uint16_t address, uint8_t type)> onWatch;
+
+    void addWatch(uint16_t start, uint16_t end, uint8_t type);
+    void clearWatches();
 
     // Aliases
     uint8_t& JOYP() { return IORegisters[0x0]; }
@@ -55,6 +108,11 @@ struct Memory {
     uint8_t& IF() { return IORegisters[0x0F]; }
     uint8_t& IE() { return IE_; }
 
+private:
+    uint8_t fetchSlow(uint16_t address);
+    uint8_t readSlow(uint16_t address);
+    void writeSlow(uint16_t address, uint8_t value);
+    void checkWatch(uint16_t address, uint8_t type);
 };
 
 #endif // EMULATOR_MEMORY_H
@@ -0,0 +1,168 @@
+#include "movie.h"
+#include "gameBoy.h"
+#include "encoding.h"
+#include <fstream>
+#include <iostream>
+
+static constexpr uint32_t MOVIE_VERSION = 3;
+
+bool Movie::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    MovieHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, "TBMV", 4) != 0) {
+        std::cerr << "Not a movie file : " << path << std::endl;
+        return false;
+    }
+    if (header.version != MOVIE_VERSION) {
+        std::cerr << "Unsupported movie version " << header.version << std::endl;
+        return false;
+    }
+
+    romHash = header.romHash;
+    frames = header.frames;
+    hashInterval = header.hashInterval;
+
+    // Sizes from the header are checked against the file before anything is allocated
+    std::streamoff position = file.tellg();
+    file.seekg(0, std::ios::end);
+    uint64_t remaining = uint64_t(file.tellg() - position);
+    file.seekg(position);
+    if (!file || header.stateBytes > remaining || header.eventBytes > remaining - header.stateBytes ||
+            header.hashCount > (remaining - header.stateBytes - header.eventBytes) / sizeof(uint32_t)) {
+        std::cerr << "Truncated movie file : " << path << std::endl;
+        return false;
+    }
+
+    start.reset();
+    if (header.stateBytes) {
+        std::vector<uint8_t> state(header.stateBytes);
+        file.read(reinterpret_cast<char*>(state.data()), std::streamsize(state.size()));
+        start.reset(new Snapshot);
+        std::memset(start.get(), 0, sizeof(Snapshot));
+        if (!file || decodeXor(state.data(), reinterpret_cast<uint8_t*>(start.get()), sizeof(Snapshot),
+                               state.data() + state.size()) != state.data() + state.size()) {
+            std::cerr << "Corrupted movie file : " << path << std::endl;
+            start.reset();
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> events(header.eventBytes);
+    file.read(reinterpret_cast<char*>(events.data()), std::streamsize(events.size()));
+    hashes.resize(header.hashCount);
+    file.read(reinterpret_cast<char*>(hashes.data()), std::streamsize(hashes.size() * sizeof(uint32_t)));
+    if (!file) {
+        std::cerr << "Truncated movie file : " << path << std::endl;
+        return false;
+    }
+
+    changes.clear();
+    const uint8_t* in = events.data();
+    const uint8_t* end = in + events.size();
+    uint64_t cycle = 0;
+    for (uint64_t i = 0; i < header.eventCount; ++i) {
+        uint64_t delta;
+        if (!readVarint(in, end, delta) || in >= end) {
+            std::cerr << "Corrupted movie file : " << path << std::endl;
+            return false;
+        }
+        cycle += delta;
+        changes.push_back({cycle, *in++});
+    }
+    return true;
+}
+
+bool Movie::save(const std::string& path) const {
+    std::vector<uint8_t> state;
+    if (start)
+        encodeXor(reinterpret_cast<const uint8_t*>(start.get()), nullptr, sizeof(Snapshot), state);
+
+    std::vector<uint8_t> events;
+    uint64_t previous = 0;
+    for (const Change& change : changes) {
+        writeVarint(events, change.cycle - previous);
+        events.push_back(change.buttons);
+        previous = change.cycle;
+    }
+
+    MovieHeader header{};
+    std::memcpy(header.magic, "TBMV", 4);
+    header.version = MOVIE_VERSION;
+    header.romHash = romHash;
+    header.frames = frames;
+    header.eventCount = changes.size();
+    header.eventBytes = events.size();
+    header.stateBytes = uint32_t(state.size());
+    header.hashInterval = hashInterval;
+    header.hashCount = hashes.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(state.data()), std::streamsize(state.size()));
+    file.write(reinterpret_cast<const char*>(events.data()), std::streamsize(events.size()));
+    file.write(reinterpret_cast<const char*>(hashes.data()), std::streamsize(hashes.size() * sizeof(uint32_t)));
+    if (!file) {
+        std::cerr << "Could not write movie file : " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MovieInput::MovieInput(const Movie& movie, uint64_t startCycle) {
+    for (const Movie::Change& change : movie.changes)
+        schedule(startCycle + change.cycle, change.buttons);
+}
+
+MovieRecorder::MovieRecorder(GameBoy& gameBoy, uint32_t hashInterval) : gameBoy(gameBoy),
+        startCycle(gameBoy.totalCycles), lastButtons(-1) {
+    recorded.romHash = gameBoy.romHash;
+    recorded.hashInterval = hashInterval;
+    if (gameBoy.totalCycles != 0) {
+        recorded.start.reset(new Snapshot);
+        if (!gameBoy.saveState(*recorded.start))
+            recorded.start.reset();
+    }
+}
+
+void MovieRecorder::record(uint64_t cycle, uint8_t buttons) {
+    // The first call is always kept : playback starts from no buttons, the recorded state may not
+    if (buttons == lastButtons)
+        return;
+    lastButtons = buttons;
+    recorded.changes.push_back({cycle - startCycle, buttons});
+}
+
+void MovieRecorder::endFrame() {
+    recorded.frames++;
+    if (recorded.frames % recorded.hashInterval == 0)
+        recorded.hashes.push_back(uint32_t(gameBoy.stateHash()));
+}
+
+bool startPlayback(GameBoy& gameBoy, const Movie& movie) {
+    if (movie.romHash != gameBoy.romHash) {
+        std::cerr << "Movie was recorded with another ROM" << std::endl;
+        return false;
+    }
+    if (movie.start && !gameBoy.loadState(*movie.start))
+        return false;
+    gameBoy.setInput(std::unique_ptr<InputSource>(new MovieInput(movie, gameBoy.totalCycles)));
+    return true;
+}
+
+bool verifyPlayback(GameBoy& gameBoy, const Movie& movie) {
+    if (!startPlayback(gameBoy, movie))
+        return false;
+
+    uint64_t startFrame = gameBoy.frameCount;
+    for (size_t i = 0; i < movie.hashes.size(); ++i) {
+        uint64_t frame = (i + 1) * movie.hashInterval;
+        gameBoy.runFrames(int(startFrame + frame - gameBoy.frameCount));
+        if (uint32_t(gameBoy.stateHash()) != movie.hashes[i]) {
+            std::cerr << "Desync between frames " << frame - movie.hashInterval << " and " << frame
+                      << " of the movie" << std::endl;
+            return false;
+        }
+    }
+    gameBoy.runFrames(int(startFrame + movie.frames - gameBoy.frameCount));
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef EMULATOR_MOVIE_H
+#define EMULATOR_MOVIE_H
+
+#include "inputSource.h"
+#include "snapshot.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class GameBoy;
+
+// Movie file : a MovieHeader, stateBytes of starting Snapshot run-length coded with encodeXor (none when
+// recorded from power-on), eventBytes of button changes and hashCount state hash checks.
+// A button change is the number of cycles since the previous one (since the start for the first one) as
+// a LEB128 varint, followed by the buttons. Check i is the low half of the state hash after frame
+// (i + 1) * hashInterval of the movie.
+struct MovieHeader {
+    char magic[4]; // "TBMV"
+    uint32_t version;
+    uint64_t romHash;
+    uint64_t frames;
+    uint64_t eventCount;
+    uint64_t eventBytes;
+    uint32_t stateBytes;
+    uint32_t hashInterval;
+    uint64_t hashCount;
+};
+
+struct Movie {
+    struct Change {
+        uint64_t cycle; // since the start of the movie
+        uint8_t buttons;
+    };
+
+    uint64_t romHash = 0;
+    uint64_t frames = 0;
+    uint32_t hashInterval = 60;
+    std::unique_ptr<Snapshot> start;
+    std::vector<Change> changes;
+    std::vector<uint32_t> hashes;
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+};
+
+// Plays the changes of a movie from the cycle it starts at
+class MovieInput : public ScriptedInput {
+public:
+    MovieInput(const Movie& movie, uint64_t startCycle);
+};
+
+// Records what the input source of a GameBoy presses, starting from its current state
+class MovieRecorder : public InputRecorder {
+public:
+    explicit MovieRecorder(GameBoy& gameBoy, uint32_t hashInterval = 60);
+
+    void record(uint64_t cycle, uint8_t buttons) override;
+    void endFrame() override;
+
+    const Movie& movie() const { return recorded; }
+
+private:
+    GameBoy& gameBoy;
+    Movie recorded;
+    uint64_t startCycle;
+    int lastButtons; // -1 before the first change
+};
+
+// Loads the starting state of the movie and plays it
+bool startPlayback(GameBoy& gameBoy, const Movie& movie);
+// Plays the whole movie at full speed, comparing the state hashes on the way
+bool verifyPlayback(GameBoy& gameBoy, const Movie& movie);
+
+#endif //EMULATOR_MOVIE_H
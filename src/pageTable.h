@@ -0,0 +1,48 @@
+#ifndef EMULATOR_PAGETABLE_H
+#define EMULATOR_PAGETABLE_H
+
+#include <cstdint>
+#include <cstring>
+
+enum WatchType : uint8_t {
+    WATCH_READ = (1 << 0),
+    WATCH_WRITE = (1 << 1),
+    WATCH_EXECUTE = (1 << 2)
+};
+
+// Host memory behind each 256 B page of the address space. A null entry sends the
+// access to the slow path, either because the page is not plain memory (MBC
+// registers, I/O) or because a watchpoint covers it.
+struct PageTable {
+    PageTable() {
+        std::memset(this, 0, sizeof(PageTable));
+    }
+
+    uint8_t* read[256];
+    uint8_t* write[256];
+    uint8_t* fetch[256];
+
+    // What the page maps to when it is not watched
+    uint8_t* readBacking[256];
+    uint8_t* writeBacking[256];
+    uint8_t watched[256];
+
+    void mapRead(int page, uint8_t* host) {
+        readBacking[page] = host;
+        read[page] = (watched[page] & WATCH_READ) ? nullptr : host;
+        fetch[page] = (watched[page] & (WATCH_READ | WATCH_EXECUTE)) ? nullptr : host;
+    }
+
+    void mapWrite(int page, uint8_t* host) {
+        writeBacking[page] = host;
+        write[page] = (watched[page] & WATCH_WRITE) ? nullptr : host;
+    }
+
+    void setWatched(int page, uint8_t flags) {
+        watched[page] = flags;
+        mapRead(page, readBacking[page]);
+        mapWrite(page, writeBacking[page]);
+    }
+};
+
+#endif //EMULATOR_PAGETABLE_H
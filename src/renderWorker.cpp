@@ -0,0 +1,70 @@
+#include "renderWorker.h"
+#include <cstring>
+
+RenderWorker::RenderWorker(Memory& source, Display& display)
+        : renderer(mirror, display), pushed(0), done(0), stopping(false) {
+    std::memcpy(mirror.VRAM, source.VRAM, sizeof(mirror.VRAM));
+    std::memcpy(mirror.OAM, source.OAM, sizeof(mirror.OAM));
+    std::memcpy(mirror.IORegisters, source.IORegisters, sizeof(mirror.IORegisters));
+    thread = std::thread(&RenderWorker::loop, this);
+}
+
+void RenderWorker::resync(Memory& source) {
+    wait();
+    std::memcpy(mirror.VRAM, source.VRAM, sizeof(mirror.VRAM));
+    std::memcpy(mirror.OAM, source.OAM, sizeof(mirror.OAM));
+    std::memcpy(mirror.IORegisters, source.IORegisters, sizeof(mirror.IORegisters));
+    renderer.background.invalidate();
+}
+
+RenderWorker::~RenderWorker() {
+    wait();
+    stopping = true;
+    thread.join();
+}
+
+void RenderWorker::pushLine(int LY, const uint8_t* registers) {
+    RenderCommand command{RENDER_LINE, uint8_t(LY), 0, {}};
+    std::memcpy(command.registers, registers, sizeof(command.registers));
+    push(command);
+}
+
+void RenderWorker::pushWrite(uint16_t address, uint8_t value) {
+    push({RENDER_WRITE, value, address, {}});
+}
+
+void RenderWorker::push(const RenderCommand& command) {
+    // A full ring means the worker is a frame behind : wait for it rather than drop anything
+    while (!ring.push(command))
+        std::this_thread::yield();
+    pushed++;
+}
+
+void RenderWorker::wait() {
+    while (done.load(std::memory_order_acquire) != pushed)
+        std::this_thread::yield();
+}
+
+void RenderWorker::loop() {
+    int idle = 0;
+    RenderCommand command;
+    while (!stopping) {
+        if (!ring.pop(command)) {
+            // Spin briefly between lines, sleep when the emulation is paced or paused
+            if (++idle < 256)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        idle = 0;
+
+        if (command.type == RENDER_LINE) {
+            std::memcpy(&mirror.IORegisters[0x40], command.registers, sizeof(command.registers));
+            renderer.printScreen(command.value);
+        } else {
+            mirror.write8(command.address, command.value);
+        }
+        done.fetch_add(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef EMULATOR_RENDERWORKER_H
+#define EMULATOR_RENDERWORKER_H
+
+#include "PPU.h"
+#include <atomic>
+#include <thread>
+
+// Single producer, single consumer ring without locks
+template <typename T, size_t Capacity>
+class SpscRing {
+public:
+    bool push(const T& item) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (head - tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[head % Capacity] = item;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == tail)
+            return false;
+        item = items[tail % Capacity];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Capacity];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
+
+enum RenderCommandType : uint8_t {
+    RENDER_LINE,
+    RENDER_WRITE
+};
+
+struct RenderCommand {
+    uint8_t type;
+    uint8_t value; // line number or written value
+    uint16_t address;
+    uint8_t registers[12]; // 0xFF40 - 0xFF4B when the line was due
+};
+
+// Draws lines on its own thread. The emulation thread pushes every due line with the registers it must be
+// drawn with, and every VRAM/OAM write in between, so the worker can replay them on a private copy of the
+// video memory. LY, STAT and the interrupts never leave the emulation thread.
+class RenderWorker {
+public:
+    RenderWorker(Memory& source, Display& display);
+    ~RenderWorker();
+
+    void pushLine(int LY, const uint8_t* registers);
+    void pushWrite(uint16_t address, uint8_t value);
+    void wait(); // until everything pushed has been drawn
+    void resync(Memory& source); // after the video memory was replaced, e.g. by a save state
+
+private:
+    void push(const RenderCommand& command);
+    void loop();
+
+    Memory mirror;
+    PPU renderer;
+    SpscRing<RenderCommand, 16384> ring;
+    uint64_t pushed;
+    std::atomic<uint64_t> done;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
+
+
+#endif //EMULATOR_RENDERWORKER_H
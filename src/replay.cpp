@@ -0,0 +1,339 @@
+#include "replay.h"
+#include "gameBoy.h"
+#include "encoding.h"
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+static constexpr uint32_t REPLAY_VERSION = 1;
+
+ReplayRecorder::ReplayRecorder(GameBoy& gameBoy, const std::string& path, uint32_t keyframeInterval,
+        uint32_t flushInterval) : gameBoy(gameBoy), file(path, std::ios::binary | std::ios::trunc), offset(0),
+        frames(0), keyframeInterval(keyframeInterval), flushInterval(flushInterval), lastCycle(0),
+        lastButtons(-1), state(new Snapshot) {
+    if (!file) {
+        std::cerr << "Error : unable to create replay file : " << path << std::endl;
+        return;
+    }
+
+    ReplayHeader header{};
+    std::memcpy(header.magic, "TBRP", 4);
+    header.version = REPLAY_VERSION;
+    header.romHash = gameBoy.romHash;
+    header.keyframeInterval = keyframeInterval;
+    header.flushInterval = flushInterval;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset = sizeof(header);
+    writeKeyframe();
+}
+
+ReplayRecorder::~ReplayRecorder() {
+    if (!valid())
+        return;
+    flushInput();
+
+    std::vector<uint8_t> entries(index.size() * sizeof(ReplayIndexEntry));
+    std::memcpy(entries.data(), index.data(), entries.size());
+    ReplayTrailer trailer{};
+    trailer.indexOffset = offset;
+    std::memcpy(trailer.magic, "TBRX", 4);
+    writeChunk(REPLAY_INDEX, entries);
+    file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+    file.flush();
+}
+
+void ReplayRecorder::record(uint64_t cycle, uint8_t buttons) {
+    if (buttons == lastButtons)
+        return;
+    lastButtons = buttons;
+    writeVarint(pending, cycle - lastCycle);
+    pending.push_back(buttons);
+    lastCycle = cycle;
+}
+
+void ReplayRecorder::endFrame() {
+    frames++;
+    if (frames % keyframeInterval == 0)
+        writeKeyframe();
+    else if (frames % flushInterval == 0)
+        flushInput();
+}
+
+void ReplayRecorder::writeChunk(uint32_t type, const std::vector<uint8_t>& payload) {
+    if (!valid())
+        return;
+    ReplayChunk chunk{type, uint32_t(payload.size()), frames, hashBytes(payload.data(), payload.size())};
+    file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+    file.write(reinterpret_cast<const char*>(payload.data()), std::streamsize(payload.size()));
+    file.flush();
+    if (type != REPLAY_INDEX)
+        index.push_back({type, chunk.size, frames, offset});
+    offset += sizeof(chunk) + payload.size();
+}
+
+void ReplayRecorder::flushInput() {
+    writeChunk(REPLAY_INPUT, pending);
+    pending.clear();
+    lastCycle = 0;
+}
+
+void ReplayRecorder::writeKeyframe() {
+    if (frames != 0)
+        flushInput();
+    if (!gameBoy.saveState(*state))
+        return;
+
+    ReplayKeyframe keyframe{gameBoy.stateHash()};
+    buffer.resize(sizeof(keyframe));
+    std::memcpy(buffer.data(), &keyframe, sizeof(keyframe));
+    encodeXor(reinterpret_cast<const uint8_t*>(state.get()), nullptr, sizeof(Snapshot), buffer);
+    writeChunk(REPLAY_KEYFRAME, buffer);
+}
+
+bool ReplayFile::open(const std::string& path) {
+    index.clear();
+    lastFrame = 0;
+    if (!file.open(path))
+        return false;
+    if (file.size() < sizeof(header) || std::memcmp(file.data(), "TBRP", 4) != 0) {
+        std::cerr << "Not a replay file : " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.version != REPLAY_VERSION) {
+        std::cerr << "Unsupported replay version " << header.version << std::endl;
+        return false;
+    }
+
+    if (!readIndex()) {
+        std::cerr << "Replay file was not closed, reading it up to its last complete chunk" << std::endl;
+        scan();
+    }
+    for (const ReplayIndexEntry& entry : index)
+        lastFrame = std::max(lastFrame, entry.frame);
+    if (index.empty() || index[0].type != REPLAY_KEYFRAME) {
+        std::cerr << "Replay file has no starting state : " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ReplayFile::readChunk(uint64_t at, ReplayChunk& chunk) const {
+    if (at < sizeof(header) || at > file.size() || file.size() - at < sizeof(chunk))
+        return false;
+    std::memcpy(&chunk, file.data() + at, sizeof(chunk));
+    if (file.size() - at - sizeof(chunk) < chunk.size)
+        return false;
+    return hashBytes(file.data() + at + sizeof(chunk), chunk.size) == chunk.checksum;
+}
+
+bool ReplayFile::readIndex() {
+    ReplayTrailer trailer;
+    ReplayChunk chunk;
+    if (file.size() < sizeof(header) + sizeof(trailer))
+        return false;
+    std::memcpy(&trailer, file.data() + file.size() - sizeof(trailer), sizeof(trailer));
+    if (std::memcmp(trailer.magic, "TBRX", 4) != 0 || !readChunk(trailer.indexOffset, chunk)
+            || chunk.type != REPLAY_INDEX || chunk.size % sizeof(ReplayIndexEntry) != 0)
+        return false;
+
+    index.resize(chunk.size / sizeof(ReplayIndexEntry));
+    std::memcpy(index.data(), file.data() + trailer.indexOffset + sizeof(chunk), chunk.size);
+    for (const ReplayIndexEntry& entry : index) {
+        if (entry.offset > trailer.indexOffset || trailer.indexOffset - entry.offset < sizeof(chunk)
+                || trailer.indexOffset - entry.offset - sizeof(chunk) < entry.size) {
+            index.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ReplayFile::scan() {
+    index.clear();
+    ReplayChunk chunk;
+    uint64_t at = sizeof(header);
+    while (readChunk(at, chunk)) {
+        if (chunk.type != REPLAY_INDEX)
+            index.push_back({chunk.type, chunk.size, chunk.frame, at});
+        at += sizeof(chunk) + chunk.size;
+    }
+}
+
+const uint8_t* ReplayFile::payload(size_t i) const {
+    // Chunks listed by the index are only checked when used, callers bound their reads with index[i].size
+    ReplayChunk chunk;
+    if (i >= index.size() || !readChunk(index[i].offset, chunk) || chunk.type != index[i].type
+            || chunk.size != index[i].size) {
+        std::cerr << "Corrupted replay chunk at offset " << (i < index.size() ? index[i].offset : 0) << std::endl;
+        return nullptr;
+    }
+    return file.data() + index[i].offset + sizeof(ReplayChunk);
+}
+
+bool ReplayFile::keyframe(size_t i, Snapshot& state, uint64_t& stateHash) const {
+    const uint8_t* in = payload(i);
+    if (!in || index[i].type != REPLAY_KEYFRAME || index[i].size < sizeof(ReplayKeyframe))
+        return false;
+    ReplayKeyframe keyframe;
+    std::memcpy(&keyframe, in, sizeof(keyframe));
+    stateHash = keyframe.stateHash;
+
+    std::memset(&state, 0, sizeof(state));
+    if (!decodeXor(in + sizeof(keyframe), reinterpret_cast<uint8_t*>(&state), sizeof(state), in + index[i].size)) {
+        std::cerr << "Corrupted replay keyframe at frame " << index[i].frame << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ReplayFile::keyframeHash(size_t i, uint64_t& stateHash) const {
+    const uint8_t* in = payload(i);
+    if (!in || index[i].type != REPLAY_KEYFRAME || index[i].size < sizeof(ReplayKeyframe))
+        return false;
+    ReplayKeyframe keyframe;
+    std::memcpy(&keyframe, in, sizeof(keyframe));
+    stateHash = keyframe.stateHash;
+    return true;
+}
+
+bool ReplayFile::scheduleInput(size_t i, uint64_t frame, ScriptedInput& input) const {
+    for (size_t j = i + 1; j < index.size(); ++j) {
+        if (index[j].type != REPLAY_INPUT)
+            continue;
+        const uint8_t* in = payload(j);
+        if (!in)
+            return false;
+        const uint8_t* end = in + index[j].size;
+        uint64_t cycle = 0;
+        while (in < end) {
+            uint64_t delta;
+            if (!readVarint(in, end, delta) || in >= end) {
+                std::cerr << "Corrupted replay input at frame " << index[j].frame << std::endl;
+                return false;
+            }
+            cycle += delta;
+            input.schedule(cycle, *in++);
+        }
+        if (index[j].frame >= frame)
+            break;
+    }
+    return true;
+}
+
+bool ReplayFile::seek(GameBoy& gameBoy, uint64_t frame) const {
+    if (header.romHash != gameBoy.romHash) {
+        std::cerr << "Replay was recorded with another ROM" << std::endl;
+        return false;
+    }
+    if (frame > lastFrame) {
+        std::cerr << "Replay only has " << lastFrame << " frames" << std::endl;
+        return false;
+    }
+
+    size_t key = 0;
+    for (size_t i = 0; i < index.size(); ++i) {
+        if (index[i].type == REPLAY_KEYFRAME && index[i].frame <= frame)
+            key = i;
+    }
+    std::unique_ptr<Snapshot> state(new Snapshot);
+    uint64_t stateHash;
+    if (!keyframe(key, *state, stateHash) || !gameBoy.loadState(*state))
+        return false;
+
+    // The buttons held at the keyframe were recorded before it
+    std::unique_ptr<ScriptedInput> input(new ScriptedInput);
+    input->schedule(state->totalCycles, state->joypad.pressed);
+    if (!scheduleInput(key, frame, *input))
+        return false;
+    gameBoy.setInput(std::move(input));
+
+    uint64_t remaining = frame - index[key].frame;
+    for (uint64_t i = 1; i <= remaining && gameBoy.running; ++i) {
+        gameBoy.ppu.silent = i < remaining;
+        gameBoy.runFrame();
+    }
+    gameBoy.ppu.silent = false;
+    return true;
+}
+
+enum SegmentResult : uint8_t {
+    SEGMENT_PENDING,
+    SEGMENT_MATCH,
+    SEGMENT_BAD_KEYFRAME,
+    SEGMENT_DESYNC
+};
+
+// Plays the recorded input from keyframe chunk `from` up to keyframe chunk `to`
+static SegmentResult verifySegment(GameBoy& gameBoy, const ReplayFile& replay, size_t from, size_t to,
+                                   Snapshot& state) {
+    uint64_t startHash, endHash;
+    if (!replay.keyframe(from, state, startHash) || !replay.keyframeHash(to, endHash)
+            || !gameBoy.loadState(state) || gameBoy.stateHash() != startHash)
+        return SEGMENT_BAD_KEYFRAME;
+
+    const std::vector<ReplayIndexEntry>& chunks = replay.chunks();
+    std::unique_ptr<ScriptedInput> input(new ScriptedInput);
+    input->schedule(state.totalCycles, state.joypad.pressed);
+    if (!replay.scheduleInput(from, chunks[to].frame, *input))
+        return SEGMENT_BAD_KEYFRAME;
+    gameBoy.setInput(std::move(input));
+
+    // The screen is not part of the state hash
+    gameBoy.ppu.silent = true;
+    gameBoy.runFrames(int(chunks[to].frame - chunks[from].frame));
+    gameBoy.ppu.silent = false;
+    return gameBoy.stateHash() == endHash ? SEGMENT_MATCH : SEGMENT_DESYNC;
+}
+
+bool verifyReplay(const std::string& romPath, const ReplayFile& replay, unsigned threads) {
+    std::vector<size_t> keyframes;
+    for (size_t i = 0; i < replay.chunks().size(); ++i) {
+        if (replay.chunks()[i].type == REPLAY_KEYFRAME)
+            keyframes.push_back(i);
+    }
+    size_t segments = keyframes.empty() ? 0 : keyframes.size() - 1;
+    if (segments == 0)
+        return true;
+
+    {
+        GameBoy gameBoy(romPath, true);
+        if (!gameBoy.running)
+            return false;
+        if (gameBoy.romHash != replay.romHash()) {
+            std::cerr << "Replay was recorded with another ROM" << std::endl;
+            return false;
+        }
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<size_t>(threads, segments));
+
+    // Workers take the next segment until there are none left
+    std::vector<SegmentResult> results(segments, SEGMENT_PENDING);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            GameBoy gameBoy(romPath, true);
+            std::unique_ptr<Snapshot> state(new Snapshot);
+            for (size_t segment = next++; segment < segments; segment = next++)
+                results[segment] = verifySegment(gameBoy, replay, keyframes[segment], keyframes[segment + 1], *state);
+        });
+    }
+    for (std::thread& worker : pool)
+        worker.join();
+
+    bool valid = true;
+    for (size_t segment = 0; segment < segments; ++segment) {
+        if (results[segment] == SEGMENT_MATCH)
+            continue;
+        valid = false;
+        const std::vector<ReplayIndexEntry>& chunks = replay.chunks();
+        std::cerr << (results[segment] == SEGMENT_DESYNC ? "Desync" : "Unreadable keyframe") << " between frames "
+                  << chunks[keyframes[segment]].frame << " and " << chunks[keyframes[segment + 1]].frame
+                  << " of the replay" << std::endl;
+    }
+    return valid;
+}
@@ -0,0 +1,132 @@
+#ifndef EMULATOR_REPLAY_H
+#define EMULATOR_REPLAY_H
+
+#include "inputSource.h"
+#include "mappedFile.h"
+#include "snapshot.h"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class GameBoy;
+
+// Replay file : a ReplayHeader followed by chunks appended while recording, each a ReplayChunk and its
+// payload. A chunk only counts when its checksum matches, so a file cut short by a crash is still read up
+// to its last complete chunk.
+//  KEYFRAME : a ReplayKeyframe and the Snapshot in encodeXor runs, the state after `frame` frames
+//  INPUT    : the button changes since the previous INPUT chunk, up to the end of frame `frame`, as
+//             (cycle delta varint, buttons) pairs. The first delta counts from cycle 0.
+//  INDEX    : a ReplayIndexEntry for every chunk before it
+// The INDEX chunk and a ReplayTrailer pointing to it are only written when the recording is closed.
+// Frames count from the start of the recording, and the input is always flushed before a keyframe.
+enum ReplayChunkType : uint32_t {
+    REPLAY_KEYFRAME = 1,
+    REPLAY_INPUT = 2,
+    REPLAY_INDEX = 3
+};
+
+struct ReplayHeader {
+    char magic[4]; // "TBRP"
+    uint32_t version;
+    uint64_t romHash;
+    uint32_t keyframeInterval;
+    uint32_t flushInterval;
+};
+
+struct ReplayChunk {
+    uint32_t type;
+    uint32_t size; // of the payload
+    uint64_t frame;
+    uint64_t checksum; // hashBytes of the payload
+};
+
+struct ReplayKeyframe {
+    uint64_t stateHash;
+};
+
+struct ReplayIndexEntry {
+    uint32_t type;
+    uint32_t size;
+    uint64_t frame;
+    uint64_t offset; // of the ReplayChunk
+};
+
+struct ReplayTrailer {
+    uint64_t indexOffset;
+    char magic[4]; // "TBRX"
+    uint32_t reserved;
+};
+
+// Appends the input and a keyframe every keyframeInterval frames to a new replay file. Chunks are flushed
+// as soon as they are written, a crash loses at most the last flushInterval frames.
+class ReplayRecorder : public InputRecorder {
+public:
+    ReplayRecorder(GameBoy& gameBoy, const std::string& path, uint32_t keyframeInterval = 300,
+                   uint32_t flushInterval = 60);
+    ~ReplayRecorder() override;
+
+    bool valid() const { return file.is_open() && file.good(); }
+
+    void record(uint64_t cycle, uint8_t buttons) override;
+    void endFrame() override;
+
+private:
+    void writeChunk(uint32_t type, const std::vector<uint8_t>& payload);
+    void flushInput();
+    void writeKeyframe();
+
+    GameBoy& gameBoy;
+    std::ofstream file;
+    uint64_t offset;
+    uint64_t frames;
+    uint32_t keyframeInterval;
+    uint32_t flushInterval;
+    std::vector<uint8_t> pending;
+    uint64_t lastCycle;
+    int lastButtons; // -1 before the first change
+    std::vector<ReplayIndexEntry> index;
+    std::unique_ptr<Snapshot> state;
+    std::vector<uint8_t> buffer;
+};
+
+// Reads a replay file in place. Opening only reads the index, or checks the chunks one after the other
+// when the file has no trailer.
+class ReplayFile {
+public:
+    bool open(const std::string& path);
+
+    uint64_t romHash() const { return header.romHash; }
+    // Frames with their input on file
+    uint64_t frames() const { return lastFrame; }
+    const std::vector<ReplayIndexEntry>& chunks() const { return index; }
+
+    // Decodes the keyframe of chunk i
+    bool keyframe(size_t i, Snapshot& state, uint64_t& stateHash) const;
+    // Reads only the state hash of the keyframe of chunk i
+    bool keyframeHash(size_t i, uint64_t& stateHash) const;
+    // Schedules the changes of the input chunks after chunk i, up to the one covering frame
+    bool scheduleInput(size_t i, uint64_t frame, ScriptedInput& input) const;
+
+    // Restores the last keyframe up to frame and plays the recorded input from there, drawing only the
+    // last frame. The GameBoy keeps the recorded input up to frame.
+    bool seek(GameBoy& gameBoy, uint64_t frame) const;
+
+private:
+    const uint8_t* payload(size_t i) const;
+    bool readChunk(uint64_t at, ReplayChunk& chunk) const;
+    bool readIndex();
+    void scan();
+
+    MappedFile file;
+    ReplayHeader header{};
+    std::vector<ReplayIndexEntry> index;
+    uint64_t lastFrame = 0;
+};
+
+// Re-simulates the segments between two keyframes on `threads` threads (0 for one per core), each with its
+// own GameBoy, and reports the segments that do not end in the state of the next keyframe. The frames after
+// the last keyframe are not checked.
+bool verifyReplay(const std::string& romPath, const ReplayFile& replay, unsigned threads = 0);
+
+#endif //EMULATOR_REPLAY_H
@@ -0,0 +1,179 @@
+#include "rewind.h"
+#include "gameBoy.h"
+#include "encoding.h"
+#include <cstddef>
+
+Rewind::Rewind(GameBoy& gameBoy, size_t budget, int keyframeInterval) : gameBoy(gameBoy), capacity(budget),
+        keyframeInterval(keyframeInterval), ring(new uint8_t[budget]), head(0), lastKeyframe(0),
+        shadow(new Snapshot), current(new Snapshot), previous(new Snapshot) {}
+
+void Rewind::reset() {
+    entries.clear();
+    head = 0;
+}
+
+size_t Rewind::bytesUsed() const {
+    size_t total = 0;
+    for (const Entry& entry : entries)
+        total += entry.deltaSize + entry.keySize;
+    return total;
+}
+
+void Rewind::capture() {
+    if (!gameBoy.saveState(*current))
+        return;
+    uint64_t frame = current->frameCount;
+    bool continuous = !entries.empty() && frame == entries.back().frame + 1;
+    if (!continuous)
+        reset();
+
+    deltaBuffer.clear();
+    keyBuffer.clear();
+    if (continuous) {
+        // The small fields, the pages written during the frame, and OAM / I/O / HRAM which also
+        // change behind write8's back. The screen is left out.
+        const size_t arena = offsetof(Snapshot, arena);
+        ranges.clear();
+        ranges.push_back({0, uint32_t(arena)});
+        for (int page = 0; page < 0x20; ++page) {
+            if (gameBoy.frameDirty.test(0x80 + page))
+                ranges.push_back({uint32_t(arena + offsetof(MemoryArena, VRAM) + 256 * page), 256});
+            if (gameBoy.frameDirty.test(0xC0 + page))
+                ranges.push_back({uint32_t(arena + offsetof(MemoryArena, WRAM) + 256 * page), 256});
+        }
+        ranges.push_back({uint32_t(arena + offsetof(MemoryArena, OAM)),
+                          uint32_t(sizeof(MemoryArena) - offsetof(MemoryArena, OAM))});
+        gameBoy.frameRamDirty.forEach([this](int page) {
+            if (uint32_t(page) * 256 < current->cartRamSize)
+                ranges.push_back({uint32_t(offsetof(Snapshot, cartRam) + 256 * page), 256});
+        });
+
+        const uint8_t* now = reinterpret_cast<const uint8_t*>(current.get());
+        const uint8_t* before = reinterpret_cast<const uint8_t*>(shadow.get());
+        for (const Range& range : ranges) {
+            if (std::memcmp(now + range.offset, before + range.offset, range.length) == 0)
+                continue;
+            size_t start = deltaBuffer.size();
+            deltaBuffer.resize(start + sizeof(Range));
+            std::memcpy(&deltaBuffer[start], &range, sizeof(Range));
+            encodeXor(now + range.offset, before + range.offset, range.length, deltaBuffer);
+        }
+    }
+
+    if (entries.empty() || frame - lastKeyframe >= uint64_t(keyframeInterval)) {
+        encodeXor(reinterpret_cast<const uint8_t*>(current.get()), nullptr, offsetof(Snapshot, screen), keyBuffer);
+        lastKeyframe = frame;
+    }
+
+    append(deltaBuffer, keyBuffer, frame);
+    std::swap(shadow, current);
+}
+
+void Rewind::append(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& key, uint64_t frame) {
+    size_t size = delta.size() + key.size();
+    if (size > capacity) {
+        reset();
+        return;
+    }
+    if (head + size > capacity)
+        head = 0;
+
+    // Makes room, one keyframe and its deltas at a time
+    auto overlaps = [this, size](const Entry& entry) {
+        return entry.offset < head + size && head < entry.offset + entry.deltaSize + entry.keySize;
+    };
+    while (!entries.empty() && overlaps(entries.front())) {
+        entries.pop_front();
+        while (!entries.empty() && entries.front().keySize == 0)
+            entries.pop_front();
+    }
+
+    if (!delta.empty())
+        std::memcpy(&ring[head], delta.data(), delta.size());
+    if (!key.empty())
+        std::memcpy(&ring[head + delta.size()], key.data(), key.size());
+    entries.push_back({head, delta.size(), key.size(), frame});
+    head += size;
+}
+
+void Rewind::applyDelta(const Entry& entry, Snapshot& state) const {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&state);
+    const uint8_t* in = &ring[entry.offset];
+    const uint8_t* end = in + entry.deltaSize;
+    while (in < end) {
+        Range range;
+        std::memcpy(&range, in, sizeof(Range));
+        in = decodeXor(in + sizeof(Range), bytes + range.offset, range.length);
+    }
+}
+
+void Rewind::stateAt(size_t index, Snapshot& state) {
+    size_t newest = entries.size() - 1;
+    size_t keyframe = index;
+    while (keyframe > 0 && entries[keyframe].keySize == 0)
+        keyframe--;
+
+    if (entries[keyframe].keySize && index - keyframe < newest - index) {
+        // Forward from the keyframe
+        const Entry& key = entries[keyframe];
+        std::memset(&state, 0, offsetof(Snapshot, screen));
+        decodeXor(&ring[key.offset + key.deltaSize], reinterpret_cast<uint8_t*>(&state), offsetof(Snapshot, screen));
+        for (size_t i = keyframe + 1; i <= index; ++i)
+            applyDelta(entries[i], state);
+    } else {
+        // Backward from the newest state
+        state = *shadow;
+        for (size_t i = newest; i > index; --i)
+            applyDelta(entries[i], state);
+    }
+}
+
+void Rewind::show(size_t index) {
+    if (index == 0) {
+        std::memcpy(current->screen, gameBoy.renderer.screenBuffer, sizeof(current->screen));
+        gameBoy.loadState(*current);
+        return;
+    }
+
+    // Emulates the frame again from the previous state to get its picture. Keyboard input only changes
+    // between frames, so the buttons of the restored state are the ones the frame was played with.
+    *previous = *current;
+    applyDelta(entries[index], *previous);
+    gameBoy.loadState(*previous);
+
+    gameBoy.ppu.requestRender();
+    gameBoy.runDetachedFrame(current->joypad.pressed);
+
+    // The state itself comes from the ring, whatever the replay did
+    std::memcpy(current->screen, gameBoy.renderer.screenBuffer, sizeof(current->screen));
+    gameBoy.loadState(*current);
+}
+
+bool Rewind::stepBack() {
+    if (entries.size() < 2)
+        return false;
+    return seek(entries[entries.size() - 2].frame);
+}
+
+bool Rewind::seek(uint64_t frame) {
+    if (entries.empty() || frame < oldestFrame() || frame > newestFrame())
+        return false;
+    size_t index = frame - oldestFrame();
+
+    stateAt(index, *current);
+    show(index);
+
+    // What came after this frame is no longer history
+    entries.resize(index + 1);
+    const Entry& last = entries.back();
+    head = last.offset + last.deltaSize + last.keySize;
+    lastKeyframe = frame;
+    for (size_t i = index + 1; i-- > 0;) {
+        if (entries[i].keySize) {
+            lastKeyframe = entries[i].frame;
+            break;
+        }
+    }
+    std::swap(shadow, current);
+    return true;
+}
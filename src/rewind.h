@@ -0,0 +1,68 @@
+#ifndef EMULATOR_REWIND_H
+#define EMULATOR_REWIND_H
+
+#include "snapshot.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+class GameBoy;
+
+// The last frames of a GameBoy in a fixed-size ring. Every frame stores the XOR between its state and the
+// previous one, run-length encoded and limited to the pages written during the frame. Every keyframeInterval
+// frames a full state is stored too. Stepping back undoes deltas from the newest state, seeking far uses the
+// nearest keyframe, and when the ring is full the oldest keyframe and its deltas go.
+// The screen is not stored : a restored frame is drawn again by emulating it from the previous state.
+class Rewind {
+public:
+    explicit Rewind(GameBoy& gameBoy, size_t budget = 4 << 20, int keyframeInterval = 120);
+
+    // After every frame
+    void capture();
+    // One frame back, false when the oldest frame is reached
+    bool stepBack();
+    bool seek(uint64_t frame);
+
+    bool empty() const { return entries.empty(); }
+    uint64_t oldestFrame() const { return entries.front().frame; }
+    uint64_t newestFrame() const { return entries.back().frame; }
+    size_t bytesUsed() const;
+
+private:
+    struct Entry {
+        size_t offset;
+        size_t deltaSize;
+        size_t keySize; // 0 if this frame has no keyframe
+        uint64_t frame;
+    };
+
+    struct Range {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    void reset();
+    void append(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& key, uint64_t frame);
+    void stateAt(size_t index, Snapshot& state);
+    void applyDelta(const Entry& entry, Snapshot& state) const;
+    void show(size_t index);
+
+    GameBoy& gameBoy;
+    size_t capacity;
+    int keyframeInterval;
+    std::unique_ptr<uint8_t[]> ring;
+    size_t head;
+    std::deque<Entry> entries;
+    uint64_t lastKeyframe;
+
+    // The newest captured state, what the next delta is taken against
+    std::unique_ptr<Snapshot> shadow;
+    std::unique_ptr<Snapshot> current;
+    std::unique_ptr<Snapshot> previous;
+    std::vector<Range> ranges;
+    std::vector<uint8_t> deltaBuffer;
+    std::vector<uint8_t> keyBuffer;
+};
+
+
+#endif //EMULATOR_REWIND_H
@@ -0,0 +1,83 @@
+#include "sharedState.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static size_t alignUp(size_t value) {
+    return (value + 63) & ~size_t(63);
+}
+
+SharedState::SharedState(const std::string& segmentName) : name(segmentName), size(0), header(nullptr) {
+#if defined(__unix__) || defined(__APPLE__)
+    size_t arenaOffset = alignUp(sizeof(SharedStateHeader));
+    size_t screenOffset = alignUp(arenaOffset + sizeof(MemoryArena));
+    size = screenOffset + 160 * 144;
+
+    // Never attach to a segment someone else may be reading, its header would be reset under them
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "Error : unable to create shared memory : " << name
+                  << (errno == EEXIST ? " already exists" : "") << std::endl;
+        return;
+    }
+    if (ftruncate(fd, size) != 0) {
+        std::cerr << "Error : unable to create shared memory : " << name << std::endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error : unable to map shared memory : " << name << std::endl;
+        shm_unlink(name.c_str());
+        return;
+    }
+
+    header = new (mapping) SharedStateHeader();
+    header->magic = SHARED_STATE_MAGIC;
+    header->version = SHARED_STATE_VERSION;
+    header->arenaOffset = arenaOffset;
+    header->arenaSize = sizeof(MemoryArena);
+    header->screenOffset = screenOffset;
+    header->screenSize = 160 * 144;
+    header->sequence = 0;
+    header->frame = 0;
+#else
+    std::cerr << "Shared memory export is only available on Unix" << std::endl;
+#endif
+}
+
+SharedState::~SharedState() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (header) {
+        munmap(header, size);
+        shm_unlink(name.c_str());
+    }
+#endif
+}
+
+MemoryArena* SharedState::arena() {
+    if (!header)
+        return nullptr;
+    return reinterpret_cast<MemoryArena*>(reinterpret_cast<uint8_t*>(header) + header->arenaOffset);
+}
+
+uint8_t* SharedState::screen() {
+    if (!header)
+        return nullptr;
+    return (reinterpret_cast<uint8_t*>(header) + header->screenOffset);
+}
+
+void SharedState::beginFrame() {
+    header->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedState::endFrame(uint64_t frame) {
+    header->frame.store(frame, std::memory_order_relaxed);
+    header->sequence.fetch_add(1, std::memory_order_release);
+}
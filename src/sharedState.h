@@ -0,0 +1,61 @@
+#ifndef EMULATOR_SHAREDSTATE_H
+#define EMULATOR_SHAREDSTATE_H
+
+#include "memory.h"
+#include "display.h"
+#include <atomic>
+#include <string>
+
+constexpr uint32_t SHARED_STATE_MAGIC = 0x53534254; // "TBSS"
+constexpr uint32_t SHARED_STATE_VERSION = 2;
+
+// Start of the shared memory segment. The arena and the screen buffer (160x144 shades 0-3)
+// follow at the given offsets and are the live memory of the emulator, not copies.
+struct SharedStateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t arenaOffset;
+    uint32_t arenaSize;
+    uint32_t screenOffset;
+    uint32_t screenSize;
+    // Seqlock : odd while a frame is being emulated, even between frames
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> frame;
+};
+
+// Reader side : calls copy() until it ran entirely between two frames
+template <typename F>
+bool readConsistent(const SharedStateHeader& header, F copy, int attempts = 1000) {
+    for (int i = 0; i < attempts; ++i) {
+        uint64_t before = header.sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+        copy();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
+
+// Writer side : owns the named POSIX shared memory segment
+class SharedState {
+public:
+    SharedState(const std::string& name);
+    ~SharedState();
+
+    bool valid() const { return header != nullptr; }
+    MemoryArena* arena();
+    uint8_t* screen();
+
+    void beginFrame();
+    void endFrame(uint64_t frame);
+
+private:
+    std::string name;
+    size_t size;
+    SharedStateHeader* header;
+};
+
+
+#endif //EMULATOR_SHAREDSTATE_H
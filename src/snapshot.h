@@ -0,0 +1,36 @@
+#ifndef EMULATOR_SNAPSHOT_H
+#define EMULATOR_SNAPSHOT_H
+
+#include "memory.h"
+#include "registers.h"
+#include "PPU.h"
+#include "joypad.h"
+
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint32_t SNAPSHOT_MAX_CART_RAM = 0x8000;
+
+// A complete machine state in a fixed layout, so it can be copied, compared or written to a file as is.
+// Settings (cheats, frame skip, render thread, palette, input source) are not part of it.
+struct Snapshot {
+    char magic[4]; // "TBSN"
+    uint32_t version;
+    uint64_t romHash;
+    uint64_t totalCycles;
+    uint64_t frameCount;
+
+    Registers regs;
+    uint8_t IME;
+    uint32_t bankState;
+    PPUState ppu;
+    int32_t divCycles;
+    int32_t timaCycles;
+    JoypadState joypad;
+
+    MemoryArena arena;
+    uint32_t cartRamSize;
+    uint8_t cartRam[SNAPSHOT_MAX_CART_RAM];
+    uint8_t screen[160*144];
+};
+
+
+#endif //EMULATOR_SNAPSHOT_H
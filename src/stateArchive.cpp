@@ -0,0 +1,168 @@
+#include "stateArchive.h"
+#include "encoding.h"
+#include "stateHash.h"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+static constexpr uint32_t ARCHIVE_VERSION = 1;
+
+struct Section {
+    size_t offset;
+    size_t length;
+};
+
+static constexpr size_t ARENA = offsetof(Snapshot, arena);
+static constexpr size_t HIGH_ARENA = ARENA + offsetof(MemoryArena, OAM);
+
+static const Section sections[ARCHIVE_SECTIONS] = {
+    {0, ARENA},
+    {ARENA + offsetof(MemoryArena, VRAM), sizeof(MemoryArena::VRAM)},
+    {ARENA + offsetof(MemoryArena, WRAM), sizeof(MemoryArena::WRAM)},
+    {HIGH_ARENA, offsetof(Snapshot, cartRam) - HIGH_ARENA},
+    {offsetof(Snapshot, cartRam), SNAPSHOT_MAX_CART_RAM},
+    {offsetof(Snapshot, screen), sizeof(Snapshot) - offsetof(Snapshot, screen)}
+};
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + 7) & ~uint64_t(7);
+}
+
+ArchiveWriter::ArchiveWriter(const std::string& path, uint64_t romHash, bool compress) : path(path),
+        file(path, std::ios::binary | std::ios::trunc), compress(compress), offset(0) {
+    if (!file) {
+        std::cerr << "Error : unable to create state archive : " << path << std::endl;
+        return;
+    }
+    std::memcpy(header.magic, "TBSA", 4);
+    header.version = ARCHIVE_VERSION;
+    header.romHash = romHash;
+    header.snapshotVersion = SNAPSHOT_VERSION;
+    header.snapshotSize = sizeof(Snapshot);
+    header.sectionCount = ARCHIVE_SECTIONS;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset = sizeof(header);
+}
+
+ArchiveWriter::~ArchiveWriter() {
+    close();
+}
+
+bool ArchiveWriter::add(uint64_t key, const Snapshot& state) {
+    if (!valid() || !keys.insert(key).second)
+        return false;
+
+    ArchiveRecord record{key, {}};
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+    for (uint32_t i = 0; i < ARCHIVE_SECTIONS; ++i)
+        record.blobs[i] = storeSection(i, bytes + sections[i].offset, sections[i].length);
+    records.push_back(record);
+    return valid();
+}
+
+uint64_t ArchiveWriter::storeSection(uint32_t section, const uint8_t* bytes, size_t length) {
+    uint64_t hash = hashBytes(bytes, length, section);
+    uint64_t check = hashBytes(bytes, length, section + ARCHIVE_SECTIONS);
+    auto stored = blobOffsets.find(hash);
+    if (stored != blobOffsets.end() && stored->second.check == check)
+        return stored->second.offset;
+
+    ArchiveBlob blob{uint32_t(length), ARCHIVE_RAW};
+    if (compress) {
+        buffer.clear();
+        encodeXor(bytes, nullptr, length, buffer);
+        if (buffer.size() < length) {
+            blob = {uint32_t(buffer.size()), ARCHIVE_RUNS};
+            bytes = buffer.data();
+        }
+    }
+
+    static const char padding[8] = {};
+    uint64_t at = offset;
+    file.write(reinterpret_cast<const char*>(&blob), sizeof(blob));
+    file.write(reinterpret_cast<const char*>(bytes), blob.size);
+    offset = alignUp(offset + sizeof(blob) + blob.size);
+    file.write(padding, std::streamsize(offset - (at + sizeof(blob) + blob.size)));
+    blobOffsets[hash] = {check, at};
+    return at;
+}
+
+bool ArchiveWriter::close() {
+    if (!file.is_open())
+        return false;
+
+    std::sort(records.begin(), records.end(),
+              [](const ArchiveRecord& a, const ArchiveRecord& b) { return a.key < b.key; });
+    header.blobCount = uint32_t(blobOffsets.size());
+    header.recordCount = records.size();
+    header.recordsOffset = offset;
+    file.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size() * sizeof(ArchiveRecord)));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file) {
+        std::cerr << "Could not write state archive : " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool StateArchive::open(const std::string& path) {
+    records = nullptr;
+    if (!file.open(path))
+        return false;
+    if (file.size() < sizeof(header) || std::memcmp(file.data(), "TBSA", 4) != 0) {
+        std::cerr << "Not a state archive : " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.version != ARCHIVE_VERSION || header.snapshotVersion != SNAPSHOT_VERSION
+            || header.snapshotSize != sizeof(Snapshot) || header.sectionCount != ARCHIVE_SECTIONS) {
+        std::cerr << "Unsupported state archive version " << header.version << std::endl;
+        return false;
+    }
+    if (header.recordsOffset == 0 || header.recordsOffset % 8 != 0 || header.recordsOffset > file.size()
+            || (file.size() - header.recordsOffset) / sizeof(ArchiveRecord) < header.recordCount) {
+        std::cerr << "State archive was not closed : " << path << std::endl;
+        return false;
+    }
+    records = reinterpret_cast<const ArchiveRecord*>(file.data() + header.recordsOffset);
+    return true;
+}
+
+const ArchiveRecord* StateArchive::find(uint64_t key) const {
+    const ArchiveRecord* end = records + header.recordCount;
+    const ArchiveRecord* found = std::lower_bound(records, end, key,
+            [](const ArchiveRecord& record, uint64_t key) { return record.key < key; });
+    return (found != end && found->key == key) ? found : nullptr;
+}
+
+bool StateArchive::load(const ArchiveRecord& record, Snapshot& state) const {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&state);
+    for (uint32_t i = 0; i < ARCHIVE_SECTIONS; ++i) {
+        ArchiveBlob blob;
+        uint64_t at = record.blobs[i];
+        if (at > header.recordsOffset || header.recordsOffset - at < sizeof(blob)) {
+            std::cerr << "Corrupted state archive record " << std::hex << record.key << std::dec << std::endl;
+            return false;
+        }
+        std::memcpy(&blob, file.data() + at, sizeof(blob));
+        const uint8_t* in = file.data() + at + sizeof(blob);
+        uint8_t* out = bytes + sections[i].offset;
+        bool fits = header.recordsOffset - at - sizeof(blob) >= blob.size;
+
+        if (fits && blob.encoding == ARCHIVE_RAW && blob.size == sections[i].length) {
+            std::memcpy(out, in, sections[i].length);
+        } else if (fits && blob.encoding == ARCHIVE_RUNS) {
+            std::memset(out, 0, sections[i].length);
+            fits = decodeXor(in, out, sections[i].length, in + blob.size) != nullptr;
+        } else {
+            fits = false;
+        }
+        if (!fits) {
+            std::cerr << "Corrupted state archive record " << std::hex << record.key << std::dec << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef EMULATOR_STATEARCHIVE_H
+#define EMULATOR_STATEARCHIVE_H
+
+#include "mappedFile.h"
+#include "snapshot.h"
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Save state archive : an ArchiveHeader, the section blobs, then an ArchiveRecord per state sorted by key.
+// A Snapshot is cut in ARCHIVE_SECTIONS fixed byte ranges (registers and counters, VRAM, WRAM, the rest of
+// the arena, cartridge RAM, screen) and every distinct range is stored once, so states sharing their tiles
+// or an untouched cartridge RAM share the blob. A blob is an ArchiveBlob and its bytes, as they are or in
+// encodeXor runs, padded to 8 bytes.
+// Loading a state copies or decodes every blob from the mapped file straight into the Snapshot.
+constexpr uint32_t ARCHIVE_SECTIONS = 6;
+
+struct ArchiveHeader {
+    char magic[4]; // "TBSA"
+    uint32_t version;
+    uint64_t romHash;
+    uint32_t snapshotVersion;
+    uint32_t snapshotSize;
+    uint32_t sectionCount;
+    uint32_t blobCount;
+    uint64_t recordCount;
+    uint64_t recordsOffset; // 0 until the archive is closed
+};
+
+enum ArchiveEncoding : uint32_t {
+    ARCHIVE_RAW = 0,
+    ARCHIVE_RUNS = 1
+};
+
+struct ArchiveBlob {
+    uint32_t size; // stored bytes
+    uint32_t encoding;
+};
+
+struct ArchiveRecord {
+    uint64_t key;
+    uint64_t blobs[ARCHIVE_SECTIONS]; // offsets of the ArchiveBlob of every section
+};
+
+// Writes a new archive. Records are kept in memory and written when the archive is closed.
+class ArchiveWriter {
+public:
+    ArchiveWriter(const std::string& path, uint64_t romHash, bool compress = true);
+    ~ArchiveWriter();
+
+    bool valid() const { return file.is_open() && file.good(); }
+
+    // False if a state with this key is archived already
+    bool add(uint64_t key, const Snapshot& state);
+    bool close();
+
+    size_t states() const { return records.size(); }
+    size_t blobs() const { return blobOffsets.size(); }
+
+private:
+    struct Stored {
+        uint64_t check; // second hash of the bytes, against collisions
+        uint64_t offset;
+    };
+
+    uint64_t storeSection(uint32_t section, const uint8_t* bytes, size_t length);
+
+    std::string path;
+    std::ofstream file;
+    ArchiveHeader header{};
+    bool compress;
+    uint64_t offset;
+    std::vector<ArchiveRecord> records;
+    std::unordered_map<uint64_t, Stored> blobOffsets;
+    std::unordered_set<uint64_t> keys;
+    std::vector<uint8_t> buffer;
+};
+
+class StateArchive {
+public:
+    bool open(const std::string& path);
+
+    uint64_t romHash() const { return header.romHash; }
+    size_t size() const { return size_t(header.recordCount); }
+    const ArchiveRecord& record(size_t i) const { return records[i]; }
+
+    // Binary search on the mapped records, nullptr if the key is not archived
+    const ArchiveRecord* find(uint64_t key) const;
+    bool load(const ArchiveRecord& record, Snapshot& state) const;
+
+private:
+    MappedFile file;
+    ArchiveHeader header{};
+    const ArchiveRecord* records = nullptr;
+};
+
+#endif //EMULATOR_STATEARCHIVE_H
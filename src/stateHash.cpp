@@ -0,0 +1,72 @@
+#include "stateHash.h"
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = seed ^ (length * 0x9E3779B97F4A7C15ull);
+
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    for (; i < length; ++i)
+        h = (h ^ bytes[i]) * 0x100000001B3ull;
+
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void StateHash::invalidate() {
+    for (int page = 0; page < 256; ++page)
+        pending.markPage(page);
+    for (int page = 0; page < 512; ++page)
+        pendingRam.markPage(page);
+}
+
+void StateHash::addDirty(const AddressDirtyMap& pages, const RamDirtyMap& ramPages) {
+    pending |= pages;
+    pendingRam |= ramPages;
+}
+
+uint64_t StateHash::value() {
+    // I/O registers are written behind write8's back
+    pending.markPage(0xFF);
+
+    pending.forEach([this](int page) {
+        uint64_t h = hashPage(page);
+        combined ^= pageHashes[page] ^ h;
+        pageHashes[page] = h;
+    });
+    pendingRam.forEach([this](int page) {
+        uint64_t h = hashRamPage(page);
+        combined ^= ramPageHashes[page] ^ h;
+        ramPageHashes[page] = h;
+    });
+    pending.clear();
+    pendingRam.clear();
+
+    return combined;
+}
+
+uint64_t StateHash::hashPage(int page) const {
+    uint16_t address = page << 8;
+    if (page >= 0x80 && page < 0xA0) // VRAM
+        return hashBytes(&memory.VRAM[address - 0x8000], 0x100, page);
+    if (page >= 0xC0 && page < 0xE0) // WRAM
+        return hashBytes(&memory.WRAM[address - 0xC000], 0x100, page);
+    if (page == 0xFE) // OAM
+        return hashBytes(memory.OAM, 0xA0, page);
+    if (page == 0xFF) // I/O Registers, HRAM, IE
+        return hashBytes(memory.IORegisters, 0x80, page) ^ hashBytes(memory.HRAM, 0x7F, memory.IE_);
+    return 0;
+}
+
+uint64_t StateHash::hashRamPage(int page) const {
+    if (!memory.cart || (page << 8) >= memory.cart->ramLength())
+        return 0;
+    return hashBytes(memory.cart->ram() + (page << 8), 0x100, 0x100 + page);
+}
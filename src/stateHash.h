@@ -0,0 +1,31 @@
+#ifndef EMULATOR_STATEHASH_H
+#define EMULATOR_STATEHASH_H
+
+#include "memory.h"
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed = 0);
+
+// Rolling hash of the RAM of the machine. Every page keeps its own hash and the
+// total is their xor, so only the pages reported dirty are read again.
+class StateHash {
+public:
+    StateHash(Memory& mem) : memory(mem) { invalidate(); }
+
+    void invalidate();
+    void addDirty(const AddressDirtyMap& pages, const RamDirtyMap& ramPages);
+    uint64_t value();
+
+private:
+    uint64_t hashPage(int page) const;
+    uint64_t hashRamPage(int page) const;
+
+    Memory& memory;
+    AddressDirtyMap pending;
+    RamDirtyMap pendingRam;
+    uint64_t pageHashes[256] = {};
+    uint64_t ramPageHashes[512] = {};
+    uint64_t combined = 0;
+};
+
+
+#endif //EMULATOR_STATEHASH_H
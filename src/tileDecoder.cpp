@@ -0,0 +1,164 @@
+#include "tileDecoder.h"
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DECODER_X86
+#define DECODER_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define DECODER_X86
+#define DECODER_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// spread[b] holds bit 7-i of b in byte i, so that a whole row is spread[lsb] | spread[msb] << 1
+struct SpreadTable {
+    uint64_t entries[256];
+
+    SpreadTable() {
+        for (int b = 0; b < 256; ++b) {
+            uint8_t bytes[8];
+            for (int pixel = 0; pixel < 8; ++pixel)
+                bytes[pixel] = (b >> (7 - pixel)) & 1;
+            std::memcpy(&entries[b], bytes, 8);
+        }
+    }
+};
+static const SpreadTable spread;
+
+void decodeTileRow(uint8_t lsb, uint8_t msb, uint8_t* ids) {
+    uint64_t row = spread.entries[lsb] | (spread.entries[msb] << 1);
+    std::memcpy(ids, &row, 8);
+}
+
+void mapPaletteScalar(const uint8_t* ids, uint8_t* out, int count, uint8_t palette) {
+    for (int i = 0; i < count; ++i)
+        out[i] = (palette >> (2 * ids[i])) & 0x03;
+}
+
+void expandShadesScalar(const uint8_t* shades, Pixel* out, int count, const Pixel* colors) {
+    for (int i = 0; i < count; ++i)
+        out[i] = colors[shades[i]];
+}
+
+#ifdef DECODER_X86
+// A palette is a 4 entry table, so one pshufb maps 16 ids at once
+DECODER_TARGET("ssse3")
+static void mapPaletteSSSE3(const uint8_t* ids, uint8_t* out, int count, uint8_t palette) {
+    const __m128i lut = _mm_setr_epi8(palette & 3, (palette >> 2) & 3, (palette >> 4) & 3, (palette >> 6) & 3,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(lut, source));
+    }
+    mapPaletteScalar(ids + i, out + i, count - i, palette);
+}
+
+DECODER_TARGET("avx2")
+static void mapPaletteAVX2(const uint8_t* ids, uint8_t* out, int count, uint8_t palette) {
+    const __m256i lut = _mm256_setr_epi8(palette & 3, (palette >> 2) & 3, (palette >> 4) & 3, (palette >> 6) & 3,
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         palette & 3, (palette >> 2) & 3, (palette >> 4) & 3, (palette >> 6) & 3,
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i source = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(lut, source));
+    }
+    mapPaletteSSSE3(ids + i, out + i, count - i, palette);
+}
+
+// The 4 colours are exactly 16 bytes, so one pshufb turns 4 shades into 4 pixels
+DECODER_TARGET("ssse3")
+static void expandShadesSSSE3(const uint8_t* shades, Pixel* out, int count, const Pixel* colors) {
+    const __m128i lut = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors));
+    const __m128i channel = _mm_set1_epi32(0x03020100);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + i));
+        for (int quarter = 0; quarter < 4; ++quarter) {
+            const char q = char(4 * quarter);
+            __m128i spreadIds = _mm_shuffle_epi8(source, _mm_setr_epi8(q, q, q, q, q+1, q+1, q+1, q+1,
+                                                                       q+2, q+2, q+2, q+2, q+3, q+3, q+3, q+3));
+            __m128i index = _mm_add_epi8(_mm_slli_epi16(spreadIds, 2), channel);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4 * quarter), _mm_shuffle_epi8(lut, index));
+        }
+    }
+    expandShadesScalar(shades + i, out + i, count - i, colors);
+}
+
+DECODER_TARGET("avx2")
+static void expandShadesAVX2(const uint8_t* shades, Pixel* out, int count, const Pixel* colors) {
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(colors)));
+    const __m256i channel = _mm256_set1_epi32(0x03020100);
+    const __m256i pattern = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                             4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t row;
+        std::memcpy(&row, shades + i, 8);
+        __m256i spreadIds = _mm256_shuffle_epi8(_mm256_set1_epi64x(int64_t(row)), pattern);
+        __m256i index = _mm256_add_epi8(_mm256_slli_epi16(spreadIds, 2), channel);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(lut, index));
+    }
+    expandShadesScalar(shades + i, out + i, count - i, colors);
+}
+#endif
+
+struct Kernels {
+    void (*mapPalette)(const uint8_t*, uint8_t*, int, uint8_t);
+    void (*expandShades)(const uint8_t*, Pixel*, int, const Pixel*);
+};
+
+static const Kernels scalarKernels = {mapPaletteScalar, expandShadesScalar};
+#ifdef DECODER_X86
+static const Kernels ssse3Kernels = {mapPaletteSSSE3, expandShadesSSSE3};
+static const Kernels avx2Kernels = {mapPaletteAVX2, expandShadesAVX2};
+#endif
+
+DecoderKernel bestKernel() {
+#if defined(DECODER_X86) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2"))
+        return KERNEL_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return KERNEL_SSSE3;
+#elif defined(DECODER_X86)
+    int info[4];
+    __cpuid(info, 1);
+    if (info[2] & (1 << 9))
+        return KERNEL_SSSE3;
+#endif
+    return KERNEL_SCALAR;
+}
+
+static const Kernels* kernelsFor(DecoderKernel kernel) {
+    switch (kernel) {
+#ifdef DECODER_X86
+        case KERNEL_AVX2:
+            return &avx2Kernels;
+        case KERNEL_SSSE3:
+            return &ssse3Kernels;
+#endif
+        default:
+            return &scalarKernels;
+    }
+}
+
+// Both functions of a kernel are swapped at once, and before any renderer thread exists
+static std::atomic<const Kernels*> kernels(kernelsFor(bestKernel()));
+
+void selectKernel(DecoderKernel kernel) {
+    kernels.store(kernelsFor(kernel), std::memory_order_release);
+}
+
+void mapPalette(const uint8_t* ids, uint8_t* out, int count, uint8_t palette) {
+    kernels.load(std::memory_order_acquire)->mapPalette(ids, out, count, palette);
+}
+
+void expandShades(const uint8_t* shades, Pixel* out, int count, const Pixel* colors) {
+    kernels.load(std::memory_order_acquire)->expandShades(shades, out, count, colors);
+}
@@ -0,0 +1,28 @@
+#ifndef EMULATOR_TILEDECODER_H
+#define EMULATOR_TILEDECODER_H
+
+#include "display.h"
+#include <cstdint>
+
+enum DecoderKernel {
+    KERNEL_SCALAR,
+    KERNEL_SSSE3,
+    KERNEL_AVX2
+};
+
+// Expands a (lsb, msb) tile row into 8 colour ids, leftmost pixel first
+void decodeTileRow(uint8_t lsb, uint8_t msb, uint8_t* ids);
+
+// Maps colour ids through a BGP/OBP style palette to shades
+void mapPalette(const uint8_t* ids, uint8_t* out, int count, uint8_t palette);
+void mapPaletteScalar(const uint8_t* ids, uint8_t* out, int count, uint8_t palette);
+
+// Turns shades into the 4 colours of a display palette
+void expandShades(const uint8_t* shades, Pixel* out, int count, const Pixel* colors);
+void expandShadesScalar(const uint8_t* shades, Pixel* out, int count, const Pixel* colors);
+
+// The best kernel of the host is picked at startup, selectKernel overrides it (e.g. for validation)
+DecoderKernel bestKernel();
+void selectKernel(DecoderKernel kernel);
+
+#endif //EMULATOR_TILEDECODER_H
@@ -0,0 +1,161 @@
+#include "timeTravel.h"
+#include "gameBoy.h"
+#include "encoding.h"
+
+static constexpr size_t NO_STATE = SIZE_MAX;
+
+TimeTravel::TimeTravel(GameBoy& gameBoy, size_t budget, uint64_t interval) : nextCapture(0), gameBoy(gameBoy),
+        capacity(budget), interval(interval), used(0), scratch(new Snapshot), wrote(false) {}
+
+void TimeTravel::capture() {
+    uint64_t cycle = gameBoy.totalCycles;
+    truncate(cycle);
+    nextCapture = cycle + interval;
+    if ((!states.empty() && states.back().cycle == cycle) || !gameBoy.saveState(*scratch))
+        return;
+
+    states.push_back({cycle, {}});
+    encodeXor(reinterpret_cast<const uint8_t*>(scratch.get()), nullptr, sizeof(Snapshot), states.back().data);
+    used += states.back().data.size();
+    while (used > capacity && states.size() > 1) {
+        used -= states.front().data.size();
+        states.pop_front();
+    }
+
+    // Changes before the oldest state are in it already
+    size_t stale = 0;
+    while (stale < changes.size() && changes[stale].cycle < states.front().cycle)
+        stale++;
+    changes.erase(changes.begin(), changes.begin() + stale);
+}
+
+void TimeTravel::recordInput(uint64_t cycle, uint8_t buttons) {
+    truncate(cycle);
+    if (!changes.empty() && changes.back().cycle == cycle)
+        changes.back().buttons = buttons;
+    else if (changes.empty() || changes.back().buttons != buttons)
+        changes.push_back({cycle, buttons});
+}
+
+// Forgets what comes after cycle : the machine went back in time, from here on it is another history
+void TimeTravel::truncate(uint64_t cycle) {
+    bool dropped = false;
+    while (!states.empty() && states.back().cycle > cycle) {
+        used -= states.back().data.size();
+        states.pop_back();
+        dropped = true;
+    }
+    while (!changes.empty() && changes.back().cycle > cycle)
+        changes.pop_back();
+    if (dropped)
+        nextCapture = states.empty() ? cycle : states.back().cycle + interval;
+}
+
+size_t TimeTravel::lastStateBefore(uint64_t cycle) const {
+    for (size_t i = states.size(); i > 0; --i) {
+        if (states[i - 1].cycle < cycle)
+            return i - 1;
+    }
+    return NO_STATE;
+}
+
+void TimeTravel::restore(size_t i) {
+    std::memset(scratch.get(), 0, sizeof(Snapshot));
+    decodeXor(states[i].data.data(), reinterpret_cast<uint8_t*>(scratch.get()), sizeof(Snapshot));
+    gameBoy.loadState(*scratch);
+
+    std::unique_ptr<ScriptedInput> input(new ScriptedInput);
+    input->schedule(states[i].cycle, scratch->joypad.pressed);
+    for (const Change& change : changes) {
+        if (change.cycle >= states[i].cycle)
+            input->schedule(change.cycle, change.buttons);
+    }
+    gameBoy.setInput(std::move(input));
+}
+
+uint64_t TimeTravel::runUntil(uint64_t end, const std::function<void(uint64_t cycle)>& beforeStep) {
+    // Unlike runFrame, frame boundaries do not move memory.dirty into frameDirty and the hasher. The frame
+    // maps only feed rewind and the recorders, which are detached, and memory.dirty keeps every page
+    // written since the restored state, whose loadState already invalidated the hasher : stateHash reads
+    // them all at once when it is next asked for.
+    while (gameBoy.running && gameBoy.totalCycles < end) {
+        // What runFrame does between two frames, a frame completed by the last step stays visible
+        if (gameBoy.ppu.frameComplete) {
+            gameBoy.frameCount++;
+            gameBoy.ppu.frameComplete = false;
+        }
+        if (beforeStep)
+            beforeStep(gameBoy.totalCycles);
+        gameBoy.step();
+    }
+    return gameBoy.totalCycles;
+}
+
+void TimeTravel::land(size_t i, uint64_t cycle) {
+    restore(i);
+    gameBoy.ppu.silent = false;
+    runUntil(cycle, nullptr);
+    truncate(gameBoy.totalCycles);
+}
+
+bool TimeTravel::stepBack(uint64_t cycles) {
+    if (states.empty())
+        return false;
+    uint64_t now = gameBoy.totalCycles;
+    uint64_t goal = now > cycles ? now - cycles : 0;
+    GameBoy::Detached detached(gameBoy);
+
+    size_t i = lastStateBefore(goal + 1);
+    if (i == NO_STATE) {
+        land(0, states[0].cycle);
+        return false;
+    }
+
+    // The instruction boundaries are only known by emulating them
+    uint64_t target = states[i].cycle;
+    restore(i);
+    gameBoy.ppu.silent = true;
+    runUntil(goal + 1, [&target](uint64_t cycle) { target = cycle; });
+    land(i, target);
+    return true;
+}
+
+bool TimeTravel::reverseContinue() {
+    uint64_t now = gameBoy.totalCycles;
+    GameBoy::Detached detached(gameBoy);
+    gameBoy.memory.onWatch = [this](uint16_t address, uint8_t type) {
+        if (type & WATCH_WRITE)
+            wrote = true;
+    };
+
+    // Newest interval first, each emulated up to where the next one starts
+    uint64_t end = now;
+    for (size_t i = lastStateBefore(now); i != NO_STATE; end = states[i].cycle, i = i ? i - 1 : NO_STATE) {
+        bool found = false;
+        uint64_t hit = 0, start = 0;
+        restore(i);
+        gameBoy.ppu.silent = true;
+        wrote = false;
+        runUntil(end, [&](uint64_t cycle) {
+            if (wrote) {
+                found = true;
+                hit = start;
+            }
+            wrote = false;
+            start = cycle;
+        });
+        if (wrote) {
+            found = true;
+            hit = start;
+        }
+        if (found) {
+            land(i, hit);
+            return true;
+        }
+    }
+
+    size_t current = lastStateBefore(now + 1);
+    if (current != NO_STATE)
+        land(current, now);
+    return false;
+}
@@ -0,0 +1,70 @@
+#ifndef EMULATOR_TIMETRAVEL_H
+#define EMULATOR_TIMETRAVEL_H
+
+#include "snapshot.h"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class GameBoy;
+
+constexpr uint64_t CYCLES_PER_LINE = 456;
+constexpr uint64_t CYCLES_PER_FRAME = 70224;
+
+// Reverse execution for the debugger. A run-length coded state is kept every `interval` cycles and every
+// button change is logged, so any earlier instruction boundary is reached by loading the last state before
+// it and emulating forward again. Going back costs at most two intervals of emulation however long the run
+// is. The oldest states go when the budget is exceeded.
+class TimeTravel {
+public:
+    explicit TimeTravel(GameBoy& gameBoy, size_t budget = 64 << 20, uint64_t interval = 60 * CYCLES_PER_FRAME);
+
+    // Called by GameBoy::step before every instruction, once the input is applied
+    void capture();
+    void recordInput(uint64_t cycle, uint8_t buttons);
+
+    // Goes back to the last instruction boundary `cycles` or more before the current one. False when the
+    // history does not go that far, the oldest state is loaded then.
+    bool stepBack(uint64_t cycles);
+    // Goes back to just before the last instruction that wrote to a write watchpoint, false if there is none
+    // in the history
+    bool reverseContinue();
+
+    uint64_t oldestCycle() const { return states.empty() ? 0 : states.front().cycle; }
+
+    uint64_t nextCapture;
+
+private:
+    struct State {
+        uint64_t cycle;
+        std::vector<uint8_t> data;
+    };
+
+    struct Change {
+        uint64_t cycle;
+        uint8_t buttons;
+    };
+
+    void truncate(uint64_t cycle);
+    // Loads states[i] with the logged input from there, invisible to the recorders and the debugger
+    void restore(size_t i);
+    // Steps while the next instruction starts before end, calling beforeStep with its start cycle.
+    // Returns where it stopped.
+    uint64_t runUntil(uint64_t end, const std::function<void(uint64_t cycle)>& beforeStep);
+    // Emulates from states[i] to the instruction boundary at cycle, drawing the screen
+    void land(size_t i, uint64_t cycle);
+    size_t lastStateBefore(uint64_t cycle) const;
+
+    GameBoy& gameBoy;
+    size_t capacity;
+    uint64_t interval;
+    size_t used;
+    std::deque<State> states;
+    std::vector<Change> changes;
+    std::unique_ptr<Snapshot> scratch;
+    bool wrote;
+};
+
+
+#endif //EMULATOR_TIMETRAVEL_H
@@ -8,6 +8,11 @@ public:
     Timer(Memory& mem) : memory(mem), divCycles(0), timaCycles(0) {}
 
     void step(int cpuCycles);
+
+    // Save states
+    int divCounter() const { return divCycles; }
+    int timaCounter() const { return timaCycles; }
+    void restore(int div, int tima) { divCycles = div; timaCycles = tima; }
 private:
     Memory& memory;
     int divCycles;
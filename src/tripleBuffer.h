@@ -0,0 +1,37 @@
+#ifndef EMULATOR_TRIPLEBUFFER_H
+#define EMULATOR_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Three frames shared by one producer and one consumer without locks. The producer always has a back buffer
+// to write, the consumer always gets the newest published frame, and neither ever waits for the other.
+template <typename T, size_t Size>
+class TripleBuffer {
+public:
+    T* back() { return buffers[backIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // The newest frame, or nullptr if nothing was published since the last call
+    const T* acquire() {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+            return nullptr;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return buffers[frontIndex];
+    }
+
+private:
+    static constexpr uint8_t INDEX = 0x03;
+    static constexpr uint8_t FRESH = 0x04;
+
+    T buffers[3][Size];
+    uint8_t backIndex = 0;
+    std::atomic<uint8_t> middle{1};
+    uint8_t frontIndex = 2;
+};
+
+
+#endif //EMULATOR_TRIPLEBUFFER_H
@@ -0,0 +1,56 @@
+#include "../src/PPU.h"
+#include "../src/display.h"
+#include "../src/memory.h"
+#include <cstdio>
+
+// Four 8 pixel wide sprites on line 0, overlapping and in descending X in OAM. Where they overlap the one
+// with the smallest X must win, whatever its OAM slot.
+int main() {
+    Memory memory;
+    Display display(memory, true);
+    PPU ppu(memory, display);
+
+    // Tiles 1, 2 and 3 are filled with colour 3, 1 and 2
+    const uint8_t rows[4][2] = {{0, 0}, {0xFF, 0xFF}, {0xFF, 0x00}, {0x00, 0xFF}};
+    for (int tile = 1; tile < 4; ++tile) {
+        for (int row = 0; row < 8; ++row) {
+            memory.VRAM[16*tile + 2*row] = rows[tile][0];
+            memory.VRAM[16*tile + 2*row + 1] = rows[tile][1];
+        }
+    }
+    memory.OBP0() = 0xE4;
+    memory.BGP() = 0xE4;
+    memory.LCDC() = 0x93;
+
+    const int xs[4] = {17, 14, 11, 8};
+    const uint8_t tiles[4] = {1, 2, 3, 1};
+    for (int i = 0; i < 4; ++i) {
+        memory.OAM[4*i] = 16;
+        memory.OAM[4*i + 1] = uint8_t(xs[i] + 8);
+        memory.OAM[4*i + 2] = tiles[i];
+        memory.OAM[4*i + 3] = 0;
+    }
+
+    // Up to the end of line 0
+    for (int cycles = 0; cycles < 456; cycles += 4)
+        ppu.step(4);
+    ppu.catchUp();
+
+    // Pixel x is drawn by the sprite with the smallest X covering it
+    int failures = 0;
+    for (int x = 0; x < 32; ++x) {
+        uint8_t expected = 0;
+        for (int i = 3; i >= 0; --i) {
+            if (x >= xs[i] && x < xs[i] + 8) {
+                expected = rows[tiles[i]][0] ? (rows[tiles[i]][1] ? 3 : 1) : 2;
+                break;
+            }
+        }
+        uint8_t actual = display.screenBuffer[x];
+        if (actual != expected) {
+            std::printf("pixel %d : shade %d, expected %d\n", x, actual, expected);
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#include "../src/tileDecoder.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Every kernel the host supports must produce the same bytes as the scalar one, for every palette and for
+// lengths that leave a tail after the 16 and 32 byte blocks.
+int main() {
+    const DecoderKernel best = bestKernel();
+    const int lengths[] = {1, 3, 7, 15, 17, 31, 33, 47, 63, 65, 97, 159, 161};
+
+    std::mt19937 random(0x7B);
+    std::vector<uint8_t> ids(256);
+    std::vector<uint8_t> expectedShades(256), actualShades(256);
+    std::vector<Pixel> expectedPixels(256), actualPixels(256);
+    Pixel colors[4];
+
+    int failures = 0;
+    for (int kernel = KERNEL_SSSE3; kernel <= best; ++kernel) {
+        for (int palette = 0; palette < 256; ++palette) {
+            for (int count : lengths) {
+                for (int i = 0; i < count; ++i)
+                    ids[i] = uint8_t(random() & 3);
+                for (auto& color : colors)
+                    color = Pixel{uint8_t(random()), uint8_t(random()), uint8_t(random()), uint8_t(random())};
+
+                selectKernel(KERNEL_SCALAR);
+                mapPalette(ids.data(), expectedShades.data(), count, uint8_t(palette));
+                expandShades(expectedShades.data(), expectedPixels.data(), count, colors);
+
+                selectKernel(DecoderKernel(kernel));
+                mapPalette(ids.data(), actualShades.data(), count, uint8_t(palette));
+                expandShades(expectedShades.data(), actualPixels.data(), count, colors);
+
+                if (std::memcmp(expectedShades.data(), actualShades.data(), count) != 0) {
+                    std::printf("kernel %d, palette %02X, %d pixels : mapPalette differs\n", kernel, palette, count);
+                    ++failures;
+                }
+                if (std::memcmp(expectedPixels.data(), actualPixels.data(), count*sizeof(Pixel)) != 0) {
+                    std::printf("kernel %d, palette %02X, %d pixels : expandShades differs\n", kernel, palette, count);
+                    ++failures;
+                }
+            }
+        }
+    }
+    selectKernel(best);
+
+    std::printf("%d kernel(s) checked, %d mismatch(es)\n", best - KERNEL_SCALAR, failures);
+    return failures ? 1 : 0;
+}